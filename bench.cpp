@@ -0,0 +1,303 @@
+#include "csg.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+
+using namespace csg;
+
+/*
+    benchmark for the core rebuild and queries. the same source is built
+    once per precision configuration (see CSG_SCALAR and
+    CSG_INTERSECTION_SCALAR in csg.hpp) so the results can be compared
+    side by side, run the bench_all target to get all of them.
+
+    besides timings it reports how far output vertices stray from the
+    planes of the faces they were built from, measured in double. this is
+    what shows up as cracks on large maps, so each scene is run once near
+    the origin and once offset by a few kilometres.
+*/
+
+using bench_clock = std::chrono::steady_clock;
+
+static double elapsed_ms(bench_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+static plane_t make_plane(const glm::dvec3& point, const glm::dvec3& normal) {
+    return plane_t{ vec3_t(normal), scalar_t(-glm::dot(point, normal)) };
+}
+
+// planes of a unit cube transformed by transform, computed in double so
+// every configuration gets the same input up to its own rounding
+static vector_t<plane_t> make_cube(const glm::dmat4& transform) {
+    glm::dmat4 normal_matrix = glm::transpose(glm::inverse(transform));
+    vector_t<plane_t> planes;
+    for (int axis=0; axis<3; ++axis) {
+        for (double sign : {1.0, -1.0}) {
+            glm::dvec3 normal(0.0);
+            normal[axis] = sign;
+            glm::dvec3 point = glm::dvec3(transform * glm::dvec4(normal, 1.0));
+            glm::dvec3 n = glm::normalize(glm::dvec3(normal_matrix * glm::dvec4(normal, 0.0)));
+            planes.push_back(make_plane(point, n));
+        }
+    }
+    return planes;
+}
+
+struct scene_t {
+    const char *name;
+    int        brush_count;
+    double     spread;
+    glm::dvec3 offset;
+};
+
+static void add_brushes(world_t& world, const scene_t& scene) {
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<double> position(-scene.spread, scene.spread);
+    std::uniform_real_distribution<double> size(0.5, 3.0);
+    std::uniform_real_distribution<double> angle(0.0, 360.0);
+    std::uniform_real_distribution<double> axis(-1.0, 1.0);
+    for (int i=0; i<scene.brush_count; ++i) {
+        brush_t *brush = world.add();
+        brush->set_volume_operation(make_fill_operation(1 + i%2));
+        glm::dmat4 transform = glm::translate(glm::dmat4(1.0), scene.offset +
+            glm::dvec3(position(rng), position(rng), position(rng)));
+        transform = glm::rotate(transform, glm::radians(angle(rng)),
+            glm::normalize(glm::dvec3(axis(rng), axis(rng), axis(rng)) + glm::dvec3(0.01)));
+        transform = glm::scale(transform, glm::dvec3(size(rng), size(rng), size(rng)));
+        brush->set_planes(make_cube(transform));
+    }
+}
+
+struct vertex_error_t {
+    double max_error = 0.0;
+    int    vertex_count = 0;
+    int    fragment_count = 0;
+};
+
+static vertex_error_t measure_error(world_t& world) {
+    vertex_error_t error;
+    for (brush_t *brush = world.first(); brush; brush = world.next(brush)) {
+        for (const face_t& face : brush->get_faces()) {
+            for (const fragment_t& fragment : face.fragments) {
+                ++error.fragment_count;
+                for (const vertex_t& vertex : fragment.vertices) {
+                    ++error.vertex_count;
+                    glm::dvec3 position(vertex.position);
+                    for (face_t *other : vertex.faces) {
+                        double d = glm::dot(glm::dvec3(other->plane->normal), position) +
+                                   double(other->plane->offset);
+                        error.max_error = glm::max(error.max_error, glm::abs(d));
+                    }
+                }
+            }
+        }
+    }
+    return error;
+}
+
+static void run_scene(const scene_t& scene) {
+    world_t world;
+
+    auto start = bench_clock::now();
+    add_brushes(world, scene);
+    world.rebuild();
+    double full_ms = elapsed_ms(start);
+
+    // move a tenth of the brushes and rebuild incrementally
+    std::mt19937 rng(5678);
+    std::uniform_real_distribution<double> position(-scene.spread, scene.spread);
+    start = bench_clock::now();
+    int i = 0;
+    for (brush_t *brush = world.first(); brush; brush = world.next(brush), ++i) {
+        if (i % 10 == 0)
+            brush->set_planes(make_cube(glm::translate(glm::dmat4(1.0), scene.offset +
+                glm::dvec3(position(rng), position(rng), position(rng)))));
+    }
+    world.rebuild();
+    double incremental_ms = elapsed_ms(start);
+
+    // reorder a tenth of the brushes, only volumes need to be recomputed
+    start = bench_clock::now();
+    i = 0;
+    for (brush_t *brush = world.first(); brush; brush = world.next(brush), ++i) {
+        if (i % 10 == 5)
+            brush->set_time(i % 7);
+    }
+    world.rebuild();
+    double retime_ms = elapsed_ms(start);
+
+    // scripted edits touching every brush several times, once with every
+    // setter marking neighbours and once batched between begin/end_edit
+    auto scripted_edits = [&]() {
+        for (int pass=0; pass<4; ++pass)
+        for (brush_t *brush = world.first(); brush; brush = world.next(brush))
+            brush->set_time(brush->get_time() + (pass%2? -1: 1));
+    };
+    double setters_ms = 1e9, batched_ms = 1e9;
+    for (int run=0; run<3; ++run) {
+        start = bench_clock::now();
+        scripted_edits();
+        setters_ms = glm::min(setters_ms, elapsed_ms(start));
+        world.rebuild();
+        start = bench_clock::now();
+        world.begin_edit();
+        scripted_edits();
+        world.end_edit();
+        batched_ms = glm::min(batched_ms, elapsed_ms(start));
+        world.rebuild();
+    }
+
+    // nudge a single brush back and forth, the typical editor interaction
+    brush_t *nudged = world.first();
+    vector_t<plane_t> nudged_planes = nudged->get_planes();
+    start = bench_clock::now();
+    for (int j=0; j<20; ++j) {
+        vector_t<plane_t> planes = nudged_planes;
+        for (plane_t& plane: planes)
+            plane.offset -= glm::dot(plane.normal, vec3_t(0.125 * (j%2), 0, 0));
+        nudged->set_planes(planes);
+        world.rebuild();
+    }
+    double edit_ms = elapsed_ms(start) / 20;
+
+    // same nudge through the transform, which skips rebuilding the faces
+    start = bench_clock::now();
+    for (int j=0; j<20; ++j) {
+        nudged->translate(vec3_t(0.125 * (j%2? 1: -1), 0, 0));
+        world.rebuild();
+    }
+    double move_ms = elapsed_ms(start) / 20;
+
+    vector_t<glm::dvec3> points(1000);
+    for (glm::dvec3& point: points)
+        point = scene.offset + glm::dvec3(position(rng), position(rng), position(rng));
+    vec3_t ray_direction = vec3_t(glm::normalize(glm::dvec3(1.0, 0.3, 0.1)));
+    start = bench_clock::now();
+    size_t hits = 0;
+    for (const glm::dvec3& point: points) {
+        hits += world.query_point(vec3_t(point)).size();
+        ray_t ray{ vec3_t(point), ray_direction };
+        hits += world.query_ray(ray).size();
+    }
+    double query_ms = elapsed_ms(start);
+
+    // the same queries run together
+    query_batch_t batch;
+    for (const glm::dvec3& point: points) {
+        batch.add_point(vec3_t(point));
+        batch.add_ray(ray_t{ vec3_t(point), ray_direction });
+    }
+    start = bench_clock::now();
+    batch.run(&world);
+    double batch_ms = elapsed_ms(start);
+    if (batch.get_brushes().size() + batch.get_hits().size() != hits)
+        printf("  batch found %zu instead of %zu\n", batch.get_brushes().size() + batch.get_hits().size(), hits);
+
+    // a copy with everything computed, instead of building it again
+    start = bench_clock::now();
+    world_t copy = world.clone();
+    double clone_ms = elapsed_ms(start);
+
+    vertex_error_t error = measure_error(world);
+    printf("  %-8s rebuild %8.1f ms  incremental %7.1f ms  retime %7.1f ms  setters %5.2f ms  batched %5.2f ms  single edit %6.2f ms  "
+           "single move %6.2f ms  queries %7.1f ms  batch %7.1f ms  clone %6.1f ms  fragments %6d  max vertex error %.3g  (%zu hits)\n",
+           scene.name, full_ms, incremental_ms, retime_ms, setters_ms, batched_ms, edit_ms, move_ms, query_ms,
+           batch_ms, clone_ms, error.fragment_count, error.max_error, hits);
+}
+
+// the same scene with every brush placed with one of a few shared shapes,
+// so faces are built once per shape instead of once per brush
+static void run_instanced_scene(const scene_t& scene) {
+    world_t world;
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<double> position(-scene.spread, scene.spread);
+    std::uniform_real_distribution<double> angle(0.0, 360.0);
+    std::uniform_real_distribution<double> axis(-1.0, 1.0);
+
+    auto start = bench_clock::now();
+    shape_t *shapes[4];
+    for (int i=0; i<4; ++i)
+        shapes[i] = world.add_shape(make_cube(glm::scale(glm::dmat4(1.0), glm::dvec3(0.5 + i, 3.0 - i*0.5, 1.0))));
+    for (int i=0; i<scene.brush_count; ++i) {
+        brush_t *brush = world.add();
+        brush->set_volume_operation(make_fill_operation(1 + i%2));
+        brush->set_shape(shapes[i%4]);
+        glm::dmat4 transform = glm::translate(glm::dmat4(1.0), scene.offset +
+            glm::dvec3(position(rng), position(rng), position(rng)));
+        transform = glm::rotate(transform, glm::radians(angle(rng)),
+            glm::normalize(glm::dvec3(axis(rng), axis(rng), axis(rng)) + glm::dvec3(0.01)));
+        brush->set_transform(mat4_t(transform));
+    }
+    int moved = 0;
+    for (const change_t& change: world.rebuild())
+        moved += (change.kinds & CHANGE_MOVED)? 1: 0;
+    double full_ms = elapsed_ms(start);
+
+    vertex_error_t error = measure_error(world);
+    printf("  %-8s instanced rebuild %8.1f ms  moved %6d  fragments %6d  max vertex error %.3g\n",
+           scene.name, full_ms, moved, error.fragment_count, error.max_error);
+}
+
+// a valve 220 .map with brush_count boxes in worldspawn, fed to the importer
+// in blocks the way a file would be read
+static void run_map_import(int brush_count) {
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<int> position(-4096, 4096);
+    std::uniform_int_distribution<int> size(8, 256);
+    std::string text = "// Game: Generic\n// Format: Valve\n{\n\"classname\" \"worldspawn\"\n";
+    char face[256];
+    for (int i=0; i<brush_count; ++i) {
+        int x0 = position(rng), y0 = position(rng), z0 = position(rng);
+        int x1 = x0 + size(rng), y1 = y0 + size(rng), z1 = z0 + size(rng);
+        // three points of each side, counter clockwise seen from outside
+        int points[6][9] = {
+            { x0,y0,z0, x0,y0+1,z0, x0,y0,z0+1 }, { x1,y1,z1, x1,y1,z1+1, x1,y1+1,z1 },
+            { x0,y0,z0, x0,y0,z0+1, x0+1,y0,z0 }, { x1,y1,z1, x1+1,y1,z1, x1,y1,z1+1 },
+            { x0,y0,z0, x0+1,y0,z0, x0,y0+1,z0 }, { x1,y1,z1, x1,y1+1,z1, x1+1,y1,z1 },
+        };
+        text += "{\n";
+        for (const int *p: points) {
+            snprintf(face, sizeof(face), "( %d %d %d ) ( %d %d %d ) ( %d %d %d ) base_wall [ 1 0 0 0 ] [ 0 -1 0 0 ] 0 1 1\n",
+                     p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7], p[8]);
+            text += face;
+        }
+        text += "}\n";
+    }
+    text += "}\n";
+
+    world_t world;
+    map_importer_t importer(&world);
+    importer.set_entity_operation([](const map_entity_t&) { return make_fill_operation(1); });
+    const size_t block_size = 1 << 20;
+    for (size_t offset=0; offset<text.size(); offset+=block_size)
+        importer.feed(text.data() + offset, glm::min(block_size, text.size() - offset));
+    importer.finish();
+
+    const map_import_stats_t& stats = importer.get_stats();
+    printf("  map import %d brushes, %.1f MB  parse %7.1f ms  add %7.1f ms  total %7.1f ms  %.1f MB/s\n",
+           stats.brushes, stats.bytes / 1e6, stats.parse_seconds * 1e3, stats.add_seconds * 1e3,
+           stats.total_seconds * 1e3, stats.megabytes_per_second);
+}
+
+int main() {
+    printf("scalar %s, intersection %s\n",
+           sizeof(scalar_t) == sizeof(double)? "double": "float",
+           sizeof(intersection_scalar_t) == sizeof(double)? "double": "float");
+
+    scene_t scenes[] = {
+        { "origin", 400, 30.0, glm::dvec3(0.0) },
+        { "4km",    400, 30.0, glm::dvec3(4000.0, 150.0, -2500.0) },
+    };
+    for (const scene_t& scene : scenes)
+        run_scene(scene);
+    for (const scene_t& scene : scenes)
+        run_instanced_scene(scene);
+    run_map_import(100000);
+    return 0;
+}
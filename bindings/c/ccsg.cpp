@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <stddef.h>
+#include <type_traits>
 #include "ccsg.h"
 
 //--------------------------------------------------------------------------------------------------
@@ -41,12 +42,13 @@ CCSG_RegisterCustomAllocator(CCSG_AllocateFunction in_alloc,
     static_assert(sizeof(C_TYPE) == sizeof(CPP_TYPE)); \
     static_assert(offsetof(C_TYPE, C_MEMBER) == offsetof(CPP_TYPE, CPP_MEMBER));
 
-static_assert(sizeof(glm::vec3) == 3 * sizeof(float));
-static_assert(sizeof(glm::mat4) == 16 * sizeof(float));
+static_assert(std::is_same_v<CCSG_Scalar, csg::scalar_t>);
+static_assert(sizeof(csg::vec3_t) == 3 * sizeof(csg::scalar_t));
+static_assert(sizeof(csg::mat4_t) == 16 * sizeof(csg::scalar_t));
 static_assert(sizeof(csg::vector_t<csg::brush_t*>) == 3 * sizeof(const void*));
 
-SIZE_ASSERT(CCSG_Vec3, glm::vec3)
-SIZE_ASSERT(CCSG_Mat4, glm::mat4)
+SIZE_ASSERT(CCSG_Vec3, csg::vec3_t)
+SIZE_ASSERT(CCSG_Mat4, csg::mat4_t)
 SIZE_ASSERT(const void*[3], csg::vector_t<csg::plane_t>)
 
 LAYOUT_ASSERTS(CCSG_Plane, csg::plane_t, offset, offset)
@@ -55,9 +57,18 @@ LAYOUT_ASSERTS(CCSG_RayHit, csg::ray_hit_t, position, position)
 LAYOUT_ASSERTS(CCSG_Box, csg::box_t, max, max)
 LAYOUT_ASSERTS(CCSG_Vertex, csg::vertex_t, _private_0, faces)
 LAYOUT_ASSERTS(CCSG_Triangle, csg::triangle_t, k, k)
+LAYOUT_ASSERTS(CCSG_Change, csg::change_t, kinds, kinds)
+LAYOUT_ASSERTS(CCSG_FragmentChange, csg::fragment_change_t, id, id)
+LAYOUT_ASSERTS(CCSG_MeshVertex, csg::mesh_vertex_t, normal, normal)
+LAYOUT_ASSERTS(CCSG_MeshGroup, csg::mesh_group_t, brush, brush)
+LAYOUT_ASSERTS(CCSG_MeshGroup, csg::mesh_group_t, changed, changed)
+LAYOUT_ASSERTS(CCSG_PackedVertex, csg::packed_vertex_t, normal, normal)
+LAYOUT_ASSERTS(CCSG_PackedChunk, csg::packed_chunk_t, index_count, index_count)
 
 LAYOUT_ASSERTS(CCSG_Fragment, csg::fragment_t, back_brush, back_brush)
+LAYOUT_ASSERTS(CCSG_Fragment, csg::fragment_t, id, id)
 LAYOUT_ASSERTS(CCSG_Face, csg::face_t, _private_1, fragments)
+LAYOUT_ASSERTS(CCSG_Face, csg::face_t, plane_sign, plane_sign)
 #undef LAYOUT_ASSERTS
 #undef SIZE_ASSERT
 
@@ -66,14 +77,13 @@ LAYOUT_ASSERTS(CCSG_Face, csg::face_t, _private_1, fragments)
 //--------------------------------------------------------------------------------------------------
 using VolumeOperation = csg::volume_operation_t;
 
-using BrushSet = csg::set_t<csg::brush_t*>;
-using BrushSet_Iterator = BrushSet::iterator;
-
 using BrushVec = csg::vector_t<csg::brush_t*>;
 using RayHitVec = csg::vector_t<csg::ray_hit_t>;
 using FaceVec = csg::vector_t<csg::face_t>;
 using PlaneVec = csg::vector_t<csg::plane_t>;
 using TriangleVec = csg::vector_t<csg::triangle_t>;
+using ChangeVec = csg::vector_t<csg::change_t>;
+using ByteVec = csg::vector_t<uint8_t>;
 
 //--------------------------------------------------------------------------------------------------
 // C <---> C++ Pointer Cast Helpers
@@ -87,6 +97,10 @@ using TriangleVec = csg::vector_t<csg::triangle_t>;
 C_CPP_PTR_CONVERT(CCSG_World, csg::world_t)
 C_CPP_PTR_CONVERT(CCSG_Face, csg::face_t)
 C_CPP_PTR_CONVERT(CCSG_Brush, csg::brush_t)
+C_CPP_PTR_CONVERT(CCSG_Shape, csg::shape_t)
+C_CPP_PTR_CONVERT(CCSG_Mesh, csg::mesh_t)
+C_CPP_PTR_CONVERT(CCSG_Triangulation, csg::triangulation_t)
+C_CPP_PTR_CONVERT(CCSG_PackedMesh, csg::packed_mesh_t)
 C_CPP_PTR_CONVERT(CCSG_Brush*, csg::brush_t*)
 C_CPP_PTR_CONVERT(CCSG_Brush *const, csg::brush_t *const)
 C_CPP_PTR_CONVERT(CCSG_Fragment, csg::fragment_t)
@@ -97,68 +111,30 @@ C_CPP_PTR_CONVERT(CCSG_RayHit, csg::ray_hit_t)
 C_CPP_PTR_CONVERT(CCSG_Box, csg::box_t)
 C_CPP_PTR_CONVERT(CCSG_Vertex, csg::vertex_t)
 C_CPP_PTR_CONVERT(CCSG_Triangle, csg::triangle_t)
+C_CPP_PTR_CONVERT(CCSG_Change, csg::change_t)
+C_CPP_PTR_CONVERT(CCSG_FragmentChange, csg::fragment_change_t)
+C_CPP_PTR_CONVERT(CCSG_MeshVertex, csg::mesh_vertex_t)
+C_CPP_PTR_CONVERT(CCSG_MeshGroup, csg::mesh_group_t)
+C_CPP_PTR_CONVERT(CCSG_PackedVertex, csg::packed_vertex_t)
+C_CPP_PTR_CONVERT(CCSG_PackedChunk, csg::packed_chunk_t)
 
 C_CPP_PTR_CONVERT(CCSG_VolumeOperation, VolumeOperation);
 
-C_CPP_PTR_CONVERT(CCSG_BrushSet, BrushSet)
-C_CPP_PTR_CONVERT(CCSG_BrushSet_Iterator, BrushSet_Iterator)
-
 C_CPP_PTR_CONVERT(CCSG_BrushVec, BrushVec)
 C_CPP_PTR_CONVERT(CCSG_RayHitVec, RayHitVec)
 C_CPP_PTR_CONVERT(CCSG_FaceVec, FaceVec)
 C_CPP_PTR_CONVERT(CCSG_PlaneVec, PlaneVec)
 C_CPP_PTR_CONVERT(CCSG_TriangleVec, TriangleVec)
+C_CPP_PTR_CONVERT(CCSG_ByteVec, ByteVec)
 
-C_CPP_PTR_CONVERT(CCSG_Vec3, glm::vec3)
-C_CPP_PTR_CONVERT(CCSG_Mat4, glm::mat4)
+C_CPP_PTR_CONVERT(CCSG_Vec3, csg::vec3_t)
+C_CPP_PTR_CONVERT(CCSG_Mat4, csg::mat4_t)
 
 #undef C_CPP_PTR_CONVERT
 
 //--------------------------------------------------------------------------------------------------
 // STL Container Methods
 //--------------------------------------------------------------------------------------------------
-void
-CCSG_BrushSet_Destroy(CCSG_BrushSet *set) {
-#   ifdef CSG_CUSTOM_ALLOCATOR_HEADER
-        toCpp(set)->~BrushSet();
-        CCSG::Free(toCpp(set));
-#   else
-        delete toCpp(set);
-#   endif
-}
-
-CCSG_BrushSet_Iterator*
-CCSG_BrushSet_Iterator_Begin(CCSG_BrushSet *set) {
-#   ifdef CSG_CUSTOM_ALLOCATOR_HEADER
-        auto iterator = static_cast<BrushSet_Iterator*>(CCSG::Allocate(sizeof(BrushSet_Iterator)));
-            ::new (iterator) BrushSet_Iterator(toCpp(set)->begin());
-#   else
-        auto iterator = new BrushSet_Iterator(toCpp(set)->begin());
-#   endif
-    return toC(iterator);
-}
-
-int // returns 0 if iterator has reached the end of the set
-CCSG_BrushSet_Iterator_Next(CCSG_BrushSet *set, CCSG_BrushSet_Iterator *last) {
-    auto iterator = *(toCpp(last));
-    if (iterator == toCpp(set)->end()) return 0;
-    std::advance(*(toCpp(last)), 1);
-    return 1;
-}
-
-const CCSG_Brush*
-CCSG_BrushSet_Iterator_Read(const CCSG_BrushSet_Iterator *iterator) { return toC(**(toCpp(iterator))); }
-
-void
-CCSG_BrushSet_Iterator_Destroy(CCSG_BrushSet_Iterator *iterator) {
-#   ifdef CSG_CUSTOM_ALLOCATOR_HEADER
-        toCpp(iterator)->~BrushSet_Iterator();
-        CCSG::Free(toCpp(iterator));
-#   else
-        delete toCpp(iterator);
-#   endif
-}
-
 void
 CCSG_BrushVec_Destroy(CCSG_BrushVec *vec) {
 #   ifdef CSG_CUSTOM_ALLOCATOR_HEADER
@@ -219,6 +195,26 @@ CCSG_TriangleVec_GetPtr(const CCSG_TriangleVec *vec, const CCSG_Triangle **out_a
     return toCpp(vec)->size();
 }
 
+void
+CCSG_ByteVec_Destroy(CCSG_ByteVec *vec) {
+#   ifdef CSG_CUSTOM_ALLOCATOR_HEADER
+        toCpp(vec)->~ByteVec();
+        CCSG::Free(toCpp(vec));
+#   else
+        delete toCpp(vec);
+#   endif
+}
+
+size_t // Return value is length of array
+CCSG_ByteVec_GetPtr(const CCSG_ByteVec *vec, const uint8_t **out_array) {
+    if (toCpp(vec)->empty()) {
+        (*out_array) = nullptr;
+        return 0;
+    }
+    (*out_array) = toCpp(vec)->data();
+    return toCpp(vec)->size();
+}
+
 //--------------------------------------------------------------------------------------------------
 // Volume Operations
 //--------------------------------------------------------------------------------------------------
@@ -268,6 +264,9 @@ CCSG_World_Create() {
 void
 CCSG_World_Destroy(CCSG_World *world) { delete toCpp(world); }
 
+CCSG_World* // Caller owns the copy and frees it with CCSG_World_Destroy. Copies what the last rebuild computed, too.
+CCSG_World_Clone(const CCSG_World *world) { return toC(new csg::world_t(toCpp(world)->clone())); }
+
 CCSG_Brush*
 CCSG_World_First(CCSG_World *world) {
     auto first = toCpp(world)->first();
@@ -288,15 +287,62 @@ CCSG_World_Remove(CCSG_World *world, CCSG_Brush *brush) { toCpp(world)->remove(t
 CCSG_Brush*
 CCSG_World_Add(CCSG_World *world) { return toC(toCpp(world)->add()); }
 
-CCSG_BrushSet* // Returns a pointer to copied memory that will be owned and freed by the caller.
-CCSG_World_Rebuild(CCSG_World *world) {
-#   ifdef CSG_CUSTOM_ALLOCATOR_HEADER
-        auto brush_set = static_cast<BrushSet*>(CCSG::Allocate(sizeof(BrushSet)));
-            ::new (brush_set) BrushSet(toCpp(world)->rebuild());
-#   else
-        auto brush_set = new BrushSet(toCpp(world)->rebuild());
-#   endif
-    return toC(brush_set);
+void // Copies the caller's arrays. Brush i takes the next plane_count_array[i] planes. operation_array (NULL entries keep the identity), time_array and out_brush_array may be NULL.
+CCSG_World_AddMany(CCSG_World *world, size_t brush_count, const CCSG_Plane *plane_array, const int *plane_count_array,
+                   const CCSG_VolumeOperation *const *operation_array, const int *time_array, CCSG_Brush **out_brush_array) {
+    csg::vector_t<VolumeOperation> operations;
+    if (operation_array) {
+        operations.reserve(brush_count);
+        for (size_t i=0; i<brush_count; ++i) {
+            if (operation_array[i])
+                operations.push_back(*toCpp(operation_array[i]));
+            else
+                operations.push_back(std::identity{});
+        }
+    }
+    toCpp(world)->add_many(int(brush_count), toCpp(plane_array), plane_count_array,
+                           operation_array? operations.data(): nullptr, time_array,
+                           reinterpret_cast<csg::brush_t**>(out_brush_array));
+}
+
+CCSG_Shape* // Makes a copy of the caller's owned memory. The caller's array can be freed afterward.
+CCSG_World_AddShape(CCSG_World *world, const CCSG_Plane *plane_array, size_t array_length) {
+    PlaneVec copied_vec(toCpp(plane_array), toCpp(plane_array + array_length));
+    return toC(toCpp(world)->add_shape(copied_vec));
+}
+
+void
+CCSG_World_RemoveShape(CCSG_World *world, CCSG_Shape *shape) { toCpp(world)->remove_shape(toCpp(shape)); }
+
+void
+CCSG_World_BeginEdit(CCSG_World *world) { toCpp(world)->begin_edit(); }
+
+void
+CCSG_World_EndEdit(CCSG_World *world) { toCpp(world)->end_edit(); }
+
+size_t // Return value is length of array. The array is library-owned and valid until the next rebuild.
+CCSG_World_Rebuild(CCSG_World *world, const CCSG_Change **out_array) {
+    const auto& changes = toCpp(world)->rebuild();
+    if (changes.empty()) {
+        (*out_array) = nullptr;
+        return 0;
+    }
+    (*out_array) = toC(changes.data());
+    return changes.size();
+}
+
+void
+CCSG_World_SetTrackFragmentChanges(CCSG_World *world, int enabled) { toCpp(world)->set_track_fragment_changes(enabled != 0); }
+
+size_t // Return value is length of array. The array is library-owned and valid until the next rebuild.
+CCSG_World_GetFragmentChanges(const CCSG_World *world, const CCSG_FragmentChange **out_array) {
+    const auto& changes = toCpp(world)->get_fragment_changes();
+    if (changes.empty()) {
+        (*out_array) = nullptr;
+        return 0;
+    }
+    (*out_array) = toC(changes.data());
+    return changes.size();
 }
 
 void
@@ -305,8 +351,11 @@ CCSG_World_SetVoidVolume(CCSG_World *world, CCSG_Volume void_volume) { toCpp(wor
 CCSG_Volume
 CCSG_World_GetVoidVolume(const CCSG_World *world) { return toCpp(world)->get_void_volume(); }
 
+const CCSG_Plane*
+CCSG_World_GetPlane(const CCSG_World *world, int plane_id) { return toC(&toCpp(world)->get_plane(plane_id)); }
+
 CCSG_BrushVec* // Returns a pointer to copied memory that will be owned and freed by the caller.
-CCSG_World_QueryPoint(CCSG_World *world, const CCSG_Vec3 *point) {
+CCSG_World_QueryPoint(const CCSG_World *world, const CCSG_Vec3 *point) {
 #   ifdef CSG_CUSTOM_ALLOCATOR_HEADER
         auto brush_vec = static_cast<BrushVec*>(CCSG::Allocate(sizeof(BrushVec)));
             ::new (brush_vec) BrushVec(toCpp(world)->query_point(*toCpp(point)));
@@ -317,7 +366,7 @@ CCSG_World_QueryPoint(CCSG_World *world, const CCSG_Vec3 *point) {
 }
 
 CCSG_BrushVec* // Returns a pointer to copied memory that will be owned and freed by the caller.
-CCSG_World_QueryBox(CCSG_World *world, const CCSG_Box *box) {
+CCSG_World_QueryBox(const CCSG_World *world, const CCSG_Box *box) {
 #   ifdef CSG_CUSTOM_ALLOCATOR_HEADER
         auto brush_vec = static_cast<BrushVec*>(CCSG::Allocate(sizeof(BrushVec)));
             ::new (brush_vec) BrushVec(toCpp(world)->query_box(*toCpp(box)));
@@ -328,7 +377,7 @@ CCSG_World_QueryBox(CCSG_World *world, const CCSG_Box *box) {
 }
 
 CCSG_RayHitVec* // Returns a pointer to copied memory that will be owned and freed by the caller.
-CCSG_World_QueryRay(CCSG_World *world, const CCSG_Ray *ray) {
+CCSG_World_QueryRay(const CCSG_World *world, const CCSG_Ray *ray) {
 #   ifdef CSG_CUSTOM_ALLOCATOR_HEADER
         auto ray_hit_vec = static_cast<RayHitVec*>(CCSG::Allocate(sizeof(RayHitVec)));
             ::new (ray_hit_vec) RayHitVec(toCpp(world)->query_ray(*toCpp(ray)));
@@ -339,7 +388,7 @@ CCSG_World_QueryRay(CCSG_World *world, const CCSG_Ray *ray) {
 }
 
 CCSG_BrushVec* // Returns a pointer to copied memory that will be owned and freed by the caller.
-CCSG_World_QueryFrustum(CCSG_World *world, const CCSG_Mat4 *view_projection) {
+CCSG_World_QueryFrustum(const CCSG_World *world, const CCSG_Mat4 *view_projection) {
 #   ifdef CSG_CUSTOM_ALLOCATOR_HEADER
         auto brush_vec = static_cast<BrushVec*>(CCSG::Allocate(sizeof(BrushVec)));
             ::new (brush_vec) BrushVec(toCpp(world)->query_frustum(*toCpp(view_projection)));
@@ -349,12 +398,173 @@ CCSG_World_QueryFrustum(CCSG_World *world, const CCSG_Mat4 *view_projection) {
     return toC(brush_vec);
 }
 
+CCSG_Volume
+CCSG_World_QueryVolume(const CCSG_World *world, const CCSG_Vec3 *point) { return toCpp(world)->query_volume(*toCpp(point)); }
+
+void
+CCSG_World_QueryVolumes(const CCSG_World *world, const CCSG_Vec3 *point_array, size_t point_count, CCSG_Volume *out_volume_array) {
+    toCpp(world)->query_volumes(toCpp(point_array), int(point_count), out_volume_array);
+}
+
+CCSG_ByteVec* // Returns a pointer to memory owned and freed by the caller, NULL if the world can't be saved (see save_snapshot).
+CCSG_World_SaveSnapshot(CCSG_World *world, int flags) {
+    ByteVec data;
+    if (!csg::save_snapshot(toCpp(world), flags, data))
+        return nullptr;
+#   ifdef CSG_CUSTOM_ALLOCATOR_HEADER
+        auto byte_vec = static_cast<ByteVec*>(CCSG::Allocate(sizeof(ByteVec)));
+            ::new (byte_vec) ByteVec(std::move(data));
+#   else
+        auto byte_vec = new ByteVec(std::move(data));
+#   endif
+    return toC(byte_vec);
+}
+
+bool // The world must be empty. The data must be 8 byte aligned and is only read during the call.
+CCSG_World_LoadSnapshot(CCSG_World *world, const void *data, size_t size) {
+    csg::snapshot_t snapshot;
+    return csg::open_snapshot(data, size, snapshot) && csg::load_snapshot(toCpp(world), snapshot);
+}
+
+bool // Adds the brushes of a .map file in memory, see map_importer_t. Returns false on parse errors.
+CCSG_World_ImportMap(CCSG_World *world, const char *text, size_t size) {
+    csg::map_importer_t importer(toCpp(world));
+    return importer.feed(text, size) && importer.finish();
+}
+
 void*
 CCSG_World_GetUserData(const CCSG_World *world) { return std::any_cast<void*>(toCpp(world)->userdata); }
 
 void
 CCSG_World_SetUserData(CCSG_World *world, void *user_data) { toCpp(world)->userdata = std::make_any<void*>(user_data); }
 
+//--------------------------------------------------------------------------------------------------
+// CCSG_Mesh
+//--------------------------------------------------------------------------------------------------
+CCSG_Mesh*
+CCSG_Mesh_Create(int grouping) {
+#   ifdef CSG_CUSTOM_ALLOCATOR_HEADER
+        assert(CCSG::Allocate && "Must register custom allocator first if CSG_CUSTOM_ALLOCATOR_HEADER is defined");
+#   endif
+    return toC(new csg::mesh_t(csg::mesh_grouping_t(grouping)));
+}
+
+void
+CCSG_Mesh_Destroy(CCSG_Mesh *mesh) { delete toCpp(mesh); }
+
+void
+CCSG_Mesh_SetOutsideVolume(CCSG_Mesh *mesh, CCSG_Volume outside_volume) { toCpp(mesh)->set_outside_volume(outside_volume); }
+
+void
+CCSG_Mesh_SetTriangulation(CCSG_Mesh *mesh, int triangulation) {
+    toCpp(mesh)->set_triangulation(csg::mesh_triangulation_t(triangulation));
+}
+
+void
+CCSG_Mesh_SetOptimizeVertexCache(CCSG_Mesh *mesh, int enabled) { toCpp(mesh)->set_optimize_vertex_cache(enabled != 0); }
+
+void
+CCSG_Mesh_Build(CCSG_Mesh *mesh, CCSG_World *world) { toCpp(mesh)->build(toCpp(world)); }
+
+void // Takes the changes returned by CCSG_World_Rebuild for the world given to CCSG_Mesh_Build.
+CCSG_Mesh_Update(CCSG_Mesh *mesh, const CCSG_Change *change_array, size_t array_length) {
+    if (array_length == 0) {
+        toCpp(mesh)->update(ChangeVec());
+        return;
+    }
+    ChangeVec copied_vec(toCpp(change_array), toCpp(change_array + array_length));
+    toCpp(mesh)->update(copied_vec);
+}
+
+size_t // Return value is length of array. The array is library-owned and valid until the next build or update.
+CCSG_Mesh_GetGroups(const CCSG_Mesh *mesh, const CCSG_MeshGroup **out_array) {
+    const auto& groups = toCpp(mesh)->get_groups();
+    if (groups.empty()) {
+        (*out_array) = nullptr;
+        return 0;
+    }
+    (*out_array) = toC(groups.data());
+    return groups.size();
+}
+
+size_t
+CCSG_Mesh_GetVertexCount(const CCSG_Mesh *mesh) { return toCpp(mesh)->get_vertex_count(); }
+
+size_t
+CCSG_Mesh_GetIndexCount(const CCSG_Mesh *mesh) { return toCpp(mesh)->get_index_count(); }
+
+void // Arrays are owned by the caller and must hold the vertex and index counts above.
+CCSG_Mesh_Write(const CCSG_Mesh *mesh, CCSG_MeshVertex *vertices, uint32_t *indices) {
+    toCpp(mesh)->write(toCpp(vertices), indices);
+}
+
+CCSG_PackedMesh*
+CCSG_PackedMesh_Create() { return toC(new csg::packed_mesh_t()); }
+
+void
+CCSG_PackedMesh_Destroy(CCSG_PackedMesh *packed) { delete toCpp(packed); }
+
+void // Chunk size 0 splits groups only where they have more than 65536 vertices.
+CCSG_Mesh_Pack(const CCSG_Mesh *mesh, CCSG_PackedMesh *packed, CCSG_Scalar chunk_size) {
+    toCpp(mesh)->pack(*toCpp(packed), chunk_size);
+}
+
+size_t // Return value is length of array. The array is library-owned and valid until the next pack.
+CCSG_PackedMesh_GetVertices(const CCSG_PackedMesh *packed, const CCSG_PackedVertex **out_array) {
+    if (toCpp(packed)->vertices.empty()) {
+        (*out_array) = nullptr;
+        return 0;
+    }
+    (*out_array) = toC(toCpp(packed)->vertices.data());
+    return toCpp(packed)->vertices.size();
+}
+
+size_t // Return value is length of array. The array is library-owned and valid until the next pack.
+CCSG_PackedMesh_GetIndices(const CCSG_PackedMesh *packed, const uint16_t **out_array) {
+    if (toCpp(packed)->indices.empty()) {
+        (*out_array) = nullptr;
+        return 0;
+    }
+    (*out_array) = toCpp(packed)->indices.data();
+    return toCpp(packed)->indices.size();
+}
+
+size_t // Return value is length of array. The array is library-owned and valid until the next pack.
+CCSG_PackedMesh_GetChunks(const CCSG_PackedMesh *packed, const CCSG_PackedChunk **out_array) {
+    if (toCpp(packed)->chunks.empty()) {
+        (*out_array) = nullptr;
+        return 0;
+    }
+    (*out_array) = toC(toCpp(packed)->chunks.data());
+    return toCpp(packed)->chunks.size();
+}
+
+void
+CCSG_UnpackVertex(const CCSG_PackedChunk *chunk, const CCSG_PackedVertex *vertex, CCSG_Vec3 *out_position, CCSG_Vec3 *out_normal) {
+    *toCpp(out_position) = csg::unpack_position(*toCpp(chunk), *toCpp(vertex));
+    *toCpp(out_normal) = csg::unpack_normal(*toCpp(vertex));
+}
+
+size_t // Return value is length of array
+CCSG_MeshGroup_GetVerticesPtr(const CCSG_MeshGroup *group, const CCSG_MeshVertex **out_array) {
+    if (toCpp(group)->vertices.empty()) {
+        (*out_array) = nullptr;
+        return 0;
+    }
+    (*out_array) = toC(toCpp(group)->vertices.data());
+    return toCpp(group)->vertices.size();
+}
+
+size_t // Return value is length of array
+CCSG_MeshGroup_GetIndicesPtr(const CCSG_MeshGroup *group, const uint32_t **out_array) {
+    if (toCpp(group)->indices.empty()) {
+        (*out_array) = nullptr;
+        return 0;
+    }
+    (*out_array) = toCpp(group)->indices.data();
+    return toCpp(group)->indices.size();
+}
+
 //--------------------------------------------------------------------------------------------------
 // CCSG_Brush
 //--------------------------------------------------------------------------------------------------
@@ -367,6 +577,27 @@ CCSG_Brush_SetPlanes(CCSG_Brush *brush, const CCSG_Plane *plane_array, size_t ar
 const CCSG_PlaneVec* // Returns pointer to library-owned memory. The caller may not manipulate nor free it.
 CCSG_Brush_GetPlanes(const CCSG_Brush *brush) { return toC(&toCpp(brush)->get_planes()); }
 
+const CCSG_PlaneVec* // Returns pointer to library-owned memory. The caller may not manipulate nor free it.
+CCSG_Shape_GetPlanes(const CCSG_Shape *shape) { return toC(&toCpp(shape)->get_planes()); }
+
+void
+CCSG_Brush_SetShape(CCSG_Brush *brush, CCSG_Shape *shape) { toCpp(brush)->set_shape(toCpp(shape)); }
+
+CCSG_Shape*
+CCSG_Brush_GetShape(const CCSG_Brush *brush) {
+    csg::shape_t *shape = toCpp(brush)->get_shape();
+    return shape? toC(shape): nullptr;
+}
+
+void
+CCSG_Brush_SetTransform(CCSG_Brush *brush, const CCSG_Mat4 *transform) { toCpp(brush)->set_transform(*toCpp(transform)); }
+
+void
+CCSG_Brush_GetTransform(const CCSG_Brush *brush, CCSG_Mat4 *out_transform) { *toCpp(out_transform) = toCpp(brush)->get_transform(); }
+
+void
+CCSG_Brush_Translate(CCSG_Brush *brush, const CCSG_Vec3 *offset) { toCpp(brush)->translate(*toCpp(offset)); }
+
 void
 CCSG_Brush_SetVolumeOperation(CCSG_Brush *brush, const CCSG_VolumeOperation *operation) {
     toCpp(brush)->set_volume_operation(*toCpp(operation));
@@ -459,6 +690,51 @@ CCSG_Triangulate(const CCSG_Fragment *fragment) {
     return toC(triangle_vec);
 }
 
+int
+CCSG_TriangleCount(const CCSG_Fragment *fragment) { return csg::triangle_count(*toCpp(fragment)); }
+
+int // Writes CCSG_TriangleCount(fragment) triangles to the caller's array and returns their number.
+CCSG_TriangulateInto(const CCSG_Fragment *fragment, CCSG_Triangle *out_triangles) {
+    csg::triangle_t *end = csg::triangulate(*toCpp(fragment), toCpp(out_triangles));
+    return int(end - toCpp(out_triangles));
+}
+
+CCSG_Triangulation*
+CCSG_Triangulation_Create() { return toC(new csg::triangulation_t()); }
+
+void
+CCSG_Triangulation_Destroy(CCSG_Triangulation *triangulation) { delete toCpp(triangulation); }
+
+void // Triangles of every fragment of every face of the brush. Reuse the triangulation to avoid allocations.
+CCSG_TriangulateBrush(const CCSG_Brush *brush, CCSG_Triangulation *triangulation) {
+    csg::triangulate(toCpp(brush), *toCpp(triangulation));
+}
+
+void // Triangles of every fragment of every face of every brush, in world order.
+CCSG_TriangulateWorld(CCSG_World *world, CCSG_Triangulation *triangulation) {
+    csg::triangulate(toCpp(world), *toCpp(triangulation));
+}
+
+size_t // Return value is length of array. The array is library-owned and valid until the next triangulation.
+CCSG_Triangulation_GetTriangles(const CCSG_Triangulation *triangulation, const CCSG_Triangle **out_array) {
+    if (toCpp(triangulation)->triangles.empty()) {
+        (*out_array) = nullptr;
+        return 0;
+    }
+    (*out_array) = toC(toCpp(triangulation)->triangles.data());
+    return toCpp(triangulation)->triangles.size();
+}
+
+size_t // Fragment i has the triangles from offset i up to offset i+1, so the array is one longer than the fragment count.
+CCSG_Triangulation_GetOffsets(const CCSG_Triangulation *triangulation, const uint32_t **out_array) {
+    if (toCpp(triangulation)->offsets.empty()) {
+        (*out_array) = nullptr;
+        return 0;
+    }
+    (*out_array) = toCpp(triangulation)->offsets.data();
+    return toCpp(triangulation)->offsets.size();
+}
+
 size_t
 CCSG_PlaneVec_GetPtr(const CCSG_PlaneVec *vec, const CCSG_Plane **out_array) {
     if (toCpp(vec)->empty()) {
@@ -1,3 +1,4 @@
+#include <stdbool.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -9,33 +10,44 @@ extern "C" {
 //--------------------------------------------------------------------------------------------------
 typedef struct CCSG_World           CCSG_World;
 typedef struct CCSG_Brush           CCSG_Brush;
+typedef struct CCSG_Shape           CCSG_Shape;
+typedef struct CCSG_Mesh            CCSG_Mesh;
+typedef struct CCSG_Triangulation   CCSG_Triangulation;
+typedef struct CCSG_PackedMesh      CCSG_PackedMesh;
 typedef struct CCSG_VolumeOperation CCSG_VolumeOperation;
 
-typedef struct CCSG_BrushSet          CCSG_BrushSet;
-typedef struct CCSG_BrushSet_Iterator CCSG_BrushSet_Iterator;
-
 typedef struct CCSG_BrushVec    CCSG_BrushVec;
 typedef struct CCSG_RayHitVec   CCSG_RayHitVec;
 typedef struct CCSG_FaceVec     CCSG_FaceVec;
 typedef struct CCSG_PlaneVec    CCSG_PlaneVec;
 typedef struct CCSG_TriangleVec CCSG_TriangleVec;
+typedef struct CCSG_ByteVec     CCSG_ByteVec;
 
 //--------------------------------------------------------------------------------------------------
 // Reinterpreted Types - Must maintain these in sync with csg types
 //--------------------------------------------------------------------------------------------------
+// must be compiled with the same CSG_SCALAR as the library (see csg.hpp)
+#ifdef CSG_SCALAR
+typedef CSG_SCALAR CCSG_Scalar;
+#else
+typedef float CCSG_Scalar;
+#endif
+
 typedef int CCSG_Volume;
-typedef float CCSG_Vec3[3];
-typedef float CCSG_Mat4[16];
+typedef CCSG_Scalar CCSG_Vec3[3];
+typedef CCSG_Scalar CCSG_Mat4[16];
 
 typedef struct CCSG_Plane {
     CCSG_Vec3 normal;
-    float offset;
+    CCSG_Scalar offset;
 } CCSG_Plane;
 
 typedef struct CCSG_Face {
     const CCSG_Plane *plane;
     const void* _private_0[3];
     const void* _private_1[3];
+    int plane_id;   // see CCSG_World_GetPlane
+    int plane_sign; // +1 if plane faces the same way as the world's plane, else -1
 } CCSG_Face;
 
 typedef struct CCSG_Fragment {
@@ -45,6 +57,7 @@ typedef struct CCSG_Fragment {
     CCSG_Volume back_volume;
     CCSG_Brush *front_brush;
     CCSG_Brush *back_brush;
+    uint64_t id; // see CCSG_World_SetTrackFragmentChanges
     int _private_1;
 } CCSG_Fragment;
 
@@ -56,7 +69,7 @@ typedef struct CCSG_RayHit {
     CCSG_Brush *brush;
     CCSG_Face *face;
     CCSG_Fragment *fragment;
-    float parameter;
+    CCSG_Scalar parameter;
     CCSG_Vec3 position;
 } CCSG_RayHit;
 
@@ -73,6 +86,68 @@ typedef struct CCSG_Triangle {
     int i, j, k;
 } CCSG_Triangle;
 
+// flags in CCSG_Change.kinds, see change_kind_t in csg.hpp
+#define CCSG_CHANGE_FACES     1
+#define CCSG_CHANGE_FRAGMENTS 2
+#define CCSG_CHANGE_BOX       4
+#define CCSG_CHANGE_REMOVED   8
+#define CCSG_CHANGE_MOVED     16
+
+typedef struct CCSG_Change {
+    CCSG_Brush *brush;
+    int kinds;
+} CCSG_Change;
+
+// values of CCSG_FragmentChange.kind, see fragment_change_kind_t in csg.hpp
+#define CCSG_FRAGMENT_KEPT    0
+#define CCSG_FRAGMENT_ADDED   1
+#define CCSG_FRAGMENT_REMOVED 2
+
+typedef struct CCSG_FragmentChange {
+    CCSG_Brush *brush;
+    int face_index;
+    int fragment_index; // -1 for removed fragments
+    int kind;
+    uint64_t id;
+} CCSG_FragmentChange;
+
+// values for CCSG_Mesh_Create, see mesh_grouping_t in csg.hpp
+#define CCSG_MESH_GROUP_BY_VOLUMES 0
+#define CCSG_MESH_GROUP_BY_BRUSH   1
+
+// values for CCSG_Mesh_SetTriangulation, see mesh_triangulation_t in csg.hpp
+#define CCSG_MESH_TRIANGULATE_STRIP      0
+#define CCSG_MESH_TRIANGULATE_MIN_WEIGHT 1
+
+#define CCSG_SNAPSHOT_COMPUTED 1
+
+typedef struct CCSG_MeshVertex {
+    CCSG_Vec3 position;
+    CCSG_Vec3 normal;
+} CCSG_MeshVertex;
+
+typedef struct CCSG_MeshGroup {
+    CCSG_Volume front_volume;
+    CCSG_Volume back_volume;
+    CCSG_Brush *brush; // NULL when grouping by volumes
+    const void* _private_0[3];
+    const void* _private_1[3];
+    bool changed;
+    int _private_2[2];
+} CCSG_MeshGroup;
+
+typedef struct CCSG_PackedVertex {
+    uint16_t position[3]; // quantized within the box of the chunk
+    int8_t normal[2];     // octahedral encoding
+} CCSG_PackedVertex;
+
+typedef struct CCSG_PackedChunk {
+    int group; // index into CCSG_Mesh_GetGroups
+    CCSG_Box box;
+    uint32_t first_vertex, vertex_count;
+    uint32_t first_index, index_count; // 16 bit indices relative to first_vertex
+} CCSG_PackedChunk;
+
 //--------------------------------------------------------------------------------------------------
 // Memory
 //--------------------------------------------------------------------------------------------------
@@ -89,22 +164,6 @@ CCSG_RegisterCustomAllocator(CCSG_AllocateFunction in_alloc,
 
 //--------------------------------------------------------------------------------------------------
 // STL Container Methods
-//--------------------------------------------------------------------------------------------------
-void
-CCSG_BrushSet_Destroy(CCSG_BrushSet *set);
-
-CCSG_BrushSet_Iterator*
-CCSG_BrushSet_Iterator_Begin(CCSG_BrushSet *set);
-
-int // returns 0 if iterator has reached the end of the set
-CCSG_BrushSet_Iterator_Next(CCSG_BrushSet *set, CCSG_BrushSet_Iterator *last);
-
-const CCSG_Brush*
-CCSG_BrushSet_Iterator_Read(const CCSG_BrushSet_Iterator *iterator);
-
-void
-CCSG_BrushSet_Iterator_Destroy(CCSG_BrushSet_Iterator *iterator);
-
 //--------------------------------------------------------------------------------------------------
 void
 CCSG_BrushVec_Destroy(CCSG_BrushVec *vec);
@@ -126,6 +185,13 @@ CCSG_TriangleVec_Destroy(CCSG_TriangleVec *vec);
 size_t // Return value is length of array
 CCSG_TriangleVec_GetPtr(const CCSG_TriangleVec *vec, const CCSG_Triangle **out_array);
 
+//--------------------------------------------------------------------------------------------------
+void
+CCSG_ByteVec_Destroy(CCSG_ByteVec *vec);
+
+size_t // Return value is length of array
+CCSG_ByteVec_GetPtr(const CCSG_ByteVec *vec, const uint8_t **out_array);
+
 //--------------------------------------------------------------------------------------------------
 // Volume Operations
 //--------------------------------------------------------------------------------------------------
@@ -147,6 +213,9 @@ CCSG_World_Create();
 void
 CCSG_World_Destroy(CCSG_World *world);
 
+CCSG_World* // Caller owns the copy and frees it with CCSG_World_Destroy. Copies what the last rebuild computed, too.
+CCSG_World_Clone(const CCSG_World *world);
+
 CCSG_Brush*
 CCSG_World_First(CCSG_World *world);
 
@@ -159,8 +228,30 @@ CCSG_World_Remove(CCSG_World *world, CCSG_Brush *brush);
 CCSG_Brush*
 CCSG_World_Add(CCSG_World *world);
 
-CCSG_BrushSet* // Returns a pointer to copied memory that will be owned and freed by the caller.
-CCSG_World_Rebuild(CCSG_World *world);
+void // Copies the caller's arrays. Brush i takes the next plane_count_array[i] planes. operation_array (NULL entries keep the identity), time_array and out_brush_array may be NULL.
+CCSG_World_AddMany(CCSG_World *world, size_t brush_count, const CCSG_Plane *plane_array, const int *plane_count_array,
+                   const CCSG_VolumeOperation *const *operation_array, const int *time_array, CCSG_Brush **out_brush_array);
+
+CCSG_Shape* // Makes a copy of the caller's owned memory. The caller's array can be freed afterward.
+CCSG_World_AddShape(CCSG_World *world, const CCSG_Plane *plane_array, size_t array_length);
+
+void // Brushes placed with the shape keep it alive until they are removed or get new planes.
+CCSG_World_RemoveShape(CCSG_World *world, CCSG_Shape *shape);
+
+void
+CCSG_World_BeginEdit(CCSG_World *world);
+
+void
+CCSG_World_EndEdit(CCSG_World *world);
+
+size_t // Return value is length of array. The array is library-owned and valid until the next rebuild.
+CCSG_World_Rebuild(CCSG_World *world, const CCSG_Change **out_array);
+
+void
+CCSG_World_SetTrackFragmentChanges(CCSG_World *world, int enabled);
+
+size_t // Return value is length of array. The array is library-owned and valid until the next rebuild.
+CCSG_World_GetFragmentChanges(const CCSG_World *world, const CCSG_FragmentChange **out_array);
 
 void
 CCSG_World_SetVoidVolume(CCSG_World *world, CCSG_Volume void_volume);
@@ -168,17 +259,36 @@ CCSG_World_SetVoidVolume(CCSG_World *world, CCSG_Volume void_volume);
 CCSG_Volume
 CCSG_World_GetVoidVolume(const CCSG_World *world);
 
+const CCSG_Plane* // Returns pointer to library-owned memory, valid until the world's planes change.
+CCSG_World_GetPlane(const CCSG_World *world, int plane_id);
+
+// queries only read the world, several threads can run them at once while no thread edits or rebuilds it
 CCSG_BrushVec* // Returns a pointer to copied memory that will be owned and freed by the caller.
-CCSG_World_QueryPoint(CCSG_World *world, const CCSG_Vec3 *point);
+CCSG_World_QueryPoint(const CCSG_World *world, const CCSG_Vec3 *point);
 
 CCSG_BrushVec* // Returns a pointer to copied memory that will be owned and freed by the caller.
-CCSG_World_QueryBox(CCSG_World *world, const CCSG_Box *box);
+CCSG_World_QueryBox(const CCSG_World *world, const CCSG_Box *box);
 
 CCSG_RayHitVec* // Returns a pointer to copied memory that will be owned and freed by the caller.
-CCSG_World_QueryRay(CCSG_World *world, const CCSG_Ray *ray);
+CCSG_World_QueryRay(const CCSG_World *world, const CCSG_Ray *ray);
 
 CCSG_BrushVec* // Returns a pointer to copied memory that will be owned and freed by the caller.
-CCSG_World_QueryFrustum(CCSG_World *world, const CCSG_Mat4 *view_projection);
+CCSG_World_QueryFrustum(const CCSG_World *world, const CCSG_Mat4 *view_projection);
+
+CCSG_Volume // The void volume changed by every brush containing the point, in csg order.
+CCSG_World_QueryVolume(const CCSG_World *world, const CCSG_Vec3 *point);
+
+void // Writes point_count volumes, faster than querying the points one by one.
+CCSG_World_QueryVolumes(const CCSG_World *world, const CCSG_Vec3 *point_array, size_t point_count, CCSG_Volume *out_volume_array);
+
+CCSG_ByteVec* // Returns a pointer to memory owned and freed by the caller, NULL if the world can't be saved (see save_snapshot).
+CCSG_World_SaveSnapshot(CCSG_World *world, int flags);
+
+bool // The world must be empty. The data must be 8 byte aligned and is only read during the call.
+CCSG_World_LoadSnapshot(CCSG_World *world, const void *data, size_t size);
+
+bool // Adds the brushes of a .map file in memory, see map_importer_t. Returns false on parse errors.
+CCSG_World_ImportMap(CCSG_World *world, const char *text, size_t size);
 
 void*
 CCSG_World_GetUserData(const CCSG_World *world);
@@ -186,6 +296,69 @@ CCSG_World_GetUserData(const CCSG_World *world);
 void
 CCSG_World_SetUserData(CCSG_World *world, void *user_data);
 
+//--------------------------------------------------------------------------------------------------
+// CCSG_Mesh
+//--------------------------------------------------------------------------------------------------
+CCSG_Mesh*
+CCSG_Mesh_Create(int grouping);
+
+void
+CCSG_Mesh_Destroy(CCSG_Mesh *mesh);
+
+void
+CCSG_Mesh_SetOutsideVolume(CCSG_Mesh *mesh, CCSG_Volume outside_volume);
+
+void
+CCSG_Mesh_SetTriangulation(CCSG_Mesh *mesh, int triangulation);
+
+void
+CCSG_Mesh_SetOptimizeVertexCache(CCSG_Mesh *mesh, int enabled);
+
+void
+CCSG_Mesh_Build(CCSG_Mesh *mesh, CCSG_World *world);
+
+void // Takes the changes returned by CCSG_World_Rebuild for the world given to CCSG_Mesh_Build.
+CCSG_Mesh_Update(CCSG_Mesh *mesh, const CCSG_Change *change_array, size_t array_length);
+
+size_t // Return value is length of array. The array is library-owned and valid until the next build or update.
+CCSG_Mesh_GetGroups(const CCSG_Mesh *mesh, const CCSG_MeshGroup **out_array);
+
+size_t
+CCSG_Mesh_GetVertexCount(const CCSG_Mesh *mesh);
+
+size_t
+CCSG_Mesh_GetIndexCount(const CCSG_Mesh *mesh);
+
+void // Arrays are owned by the caller and must hold the vertex and index counts above.
+CCSG_Mesh_Write(const CCSG_Mesh *mesh, CCSG_MeshVertex *vertices, uint32_t *indices);
+
+CCSG_PackedMesh*
+CCSG_PackedMesh_Create();
+
+void
+CCSG_PackedMesh_Destroy(CCSG_PackedMesh *packed);
+
+void // Chunk size 0 splits groups only where they have more than 65536 vertices.
+CCSG_Mesh_Pack(const CCSG_Mesh *mesh, CCSG_PackedMesh *packed, CCSG_Scalar chunk_size);
+
+size_t // Return value is length of array. The array is library-owned and valid until the next pack.
+CCSG_PackedMesh_GetVertices(const CCSG_PackedMesh *packed, const CCSG_PackedVertex **out_array);
+
+size_t // Return value is length of array. The array is library-owned and valid until the next pack.
+CCSG_PackedMesh_GetIndices(const CCSG_PackedMesh *packed, const uint16_t **out_array);
+
+size_t // Return value is length of array. The array is library-owned and valid until the next pack.
+CCSG_PackedMesh_GetChunks(const CCSG_PackedMesh *packed, const CCSG_PackedChunk **out_array);
+
+void
+CCSG_UnpackVertex(const CCSG_PackedChunk *chunk, const CCSG_PackedVertex *vertex, CCSG_Vec3 *out_position, CCSG_Vec3 *out_normal);
+
+size_t // Return value is length of array
+CCSG_MeshGroup_GetVerticesPtr(const CCSG_MeshGroup *group, const CCSG_MeshVertex **out_array);
+
+size_t // Return value is length of array
+CCSG_MeshGroup_GetIndicesPtr(const CCSG_MeshGroup *group, const uint32_t **out_array);
+
 //--------------------------------------------------------------------------------------------------
 // CCSG_Brush
 //--------------------------------------------------------------------------------------------------
@@ -195,6 +368,24 @@ CCSG_Brush_SetPlanes(CCSG_Brush *brush, const CCSG_Plane *plane_array, size_t ar
 const CCSG_PlaneVec* // Returns pointer to library-owned memory. The caller may not manipulate nor free it.
 CCSG_Brush_GetPlanes(const CCSG_Brush *brush);
 
+const CCSG_PlaneVec* // Returns pointer to library-owned memory. The caller may not manipulate nor free it.
+CCSG_Shape_GetPlanes(const CCSG_Shape *shape);
+
+void
+CCSG_Brush_SetShape(CCSG_Brush *brush, CCSG_Shape *shape);
+
+CCSG_Shape* // Returns NULL if the brush has planes of its own.
+CCSG_Brush_GetShape(const CCSG_Brush *brush);
+
+void
+CCSG_Brush_SetTransform(CCSG_Brush *brush, const CCSG_Mat4 *transform);
+
+void
+CCSG_Brush_GetTransform(const CCSG_Brush *brush, CCSG_Mat4 *out_transform);
+
+void
+CCSG_Brush_Translate(CCSG_Brush *brush, const CCSG_Vec3 *offset);
+
 void
 CCSG_Brush_SetVolumeOperation(CCSG_Brush *brush, const CCSG_VolumeOperation *operation);
 
@@ -243,6 +434,30 @@ CCSG_FaceVec_GetPtr(const CCSG_FaceVec *vec, const CCSG_Face **outArray);
 CCSG_TriangleVec* // Returns a pointer to copied memory that will be owned and freed by the caller.
 CCSG_Triangulate(const CCSG_Fragment *fragment);
 
+int
+CCSG_TriangleCount(const CCSG_Fragment *fragment);
+
+int // Writes CCSG_TriangleCount(fragment) triangles to the caller's array and returns their number.
+CCSG_TriangulateInto(const CCSG_Fragment *fragment, CCSG_Triangle *out_triangles);
+
+CCSG_Triangulation*
+CCSG_Triangulation_Create();
+
+void
+CCSG_Triangulation_Destroy(CCSG_Triangulation *triangulation);
+
+void // Triangles of every fragment of every face of the brush. Reuse the triangulation to avoid allocations.
+CCSG_TriangulateBrush(const CCSG_Brush *brush, CCSG_Triangulation *triangulation);
+
+void // Triangles of every fragment of every face of every brush, in world order.
+CCSG_TriangulateWorld(CCSG_World *world, CCSG_Triangulation *triangulation);
+
+size_t // Return value is length of array. The array is library-owned and valid until the next triangulation.
+CCSG_Triangulation_GetTriangles(const CCSG_Triangulation *triangulation, const CCSG_Triangle **out_array);
+
+size_t // Fragment i has the triangles from offset i up to offset i+1, so the array is one longer than the fragment count.
+CCSG_Triangulation_GetOffsets(const CCSG_Triangulation *triangulation, const uint32_t **out_array);
+
 size_t // Return value is length of array
 CCSG_PlaneVec_GetPtr(const CCSG_PlaneVec *vec, const CCSG_Plane **outArray);
 
@@ -2,6 +2,7 @@
 const std = @import("std");
 const options = @import("zcsg_options");
 const c = @cImport({
+    if (options.use_double_precision) @cDefine("CSG_SCALAR", "double");
     @cInclude("ccsg.h");
 });
 
@@ -100,13 +101,14 @@ fn zcsgFree(maybe_ptr: ?*anyopaque) callconv(.C) void {
 //--------------------------------------------------------------------------------------------------
 // Reinterpreted Types - Must maintain these in sync with csg types
 //--------------------------------------------------------------------------------------------------
+pub const Scalar = if (options.use_double_precision) f64 else f32;
 pub const Volume = i32;
-pub const Vec3 = [3]f32;
-pub const Mat4 = [16]f32;
+pub const Vec3 = [3]Scalar;
+pub const Mat4 = [16]Scalar;
 
 pub const Plane = extern struct {
     normal: Vec3,
-    offset: f32,
+    offset: Scalar,
 
     comptime { std.debug.assert(@sizeOf(@This()) == @sizeOf(c.CCSG_Plane)); }
 };
@@ -115,6 +117,8 @@ pub const Face = extern struct {
     plane: *const Plane,
     _pad0: [3]*const anyopaque,
     _pad1: [3]*const anyopaque,
+    plane_id: i32,
+    plane_sign: i32,
 
     comptime { std.debug.assert(@sizeOf(@This()) == @sizeOf(c.CCSG_Face)); }
 
@@ -149,6 +153,7 @@ pub const Fragment = extern struct {
     back_volume: Volume,
     front_brush: *Brush,
     back_brush: *Brush,
+    id: u64,
     _pad1: i32,
 
     comptime { std.debug.assert(@sizeOf(@This()) == @sizeOf(c.CCSG_Fragment)); }
@@ -177,7 +182,7 @@ pub const RayHit = extern struct {
     brush: *Brush,
     face: *Face,
     fragment: *Fragment,
-    parameter: f32,
+    parameter: Scalar,
     position: Vec3,
 
     comptime { std.debug.assert(@sizeOf(@This()) == @sizeOf(c.CCSG_RayHit)); }
@@ -188,10 +193,10 @@ pub const Box = extern struct {
     max: Vec3 = .{ 0, 0, 0 },
 
     pub fn encompass(box: *Box, other: Box) void {
-        const box_min: @Vector(3, f32) = box.min;
-        const box_max: @Vector(3, f32) = box.max;
-        const other_min: @Vector(3, f32) = other.min;
-        const other_max: @Vector(3, f32) = other.max;
+        const box_min: @Vector(3, Scalar) = box.min;
+        const box_max: @Vector(3, Scalar) = box.max;
+        const other_min: @Vector(3, Scalar) = other.min;
+        const other_max: @Vector(3, Scalar) = other.max;
         box.min = @min(box_min, other_min);
         box.max = @max(box_max, other_max);
     }
@@ -214,6 +219,101 @@ pub const Triangle = extern struct {
     comptime { std.debug.assert(@sizeOf(@This()) == @sizeOf(c.CCSG_Triangle)); }
 };
 
+pub const Change = extern struct {
+    brush: *Brush,
+    kinds: i32,
+
+    // flags in kinds
+    pub const faces: i32 = c.CCSG_CHANGE_FACES;
+    pub const fragments: i32 = c.CCSG_CHANGE_FRAGMENTS;
+    pub const box: i32 = c.CCSG_CHANGE_BOX;
+    pub const removed: i32 = c.CCSG_CHANGE_REMOVED;
+    pub const moved: i32 = c.CCSG_CHANGE_MOVED;
+
+    comptime { std.debug.assert(@sizeOf(@This()) == @sizeOf(c.CCSG_Change)); }
+};
+
+pub const FragmentChange = extern struct {
+    brush: *Brush,
+    face_index: i32,
+    fragment_index: i32, // -1 for removed fragments
+    kind: i32,
+    id: u64,
+
+    // values of kind
+    pub const kept: i32 = c.CCSG_FRAGMENT_KEPT;
+    pub const added: i32 = c.CCSG_FRAGMENT_ADDED;
+    pub const removed: i32 = c.CCSG_FRAGMENT_REMOVED;
+
+    comptime { std.debug.assert(@sizeOf(@This()) == @sizeOf(c.CCSG_FragmentChange)); }
+};
+
+pub const MeshVertex = extern struct {
+    position: Vec3,
+    normal: Vec3,
+
+    comptime { std.debug.assert(@sizeOf(@This()) == @sizeOf(c.CCSG_MeshVertex)); }
+};
+
+pub const MeshGroup = extern struct {
+    front_volume: Volume,
+    back_volume: Volume,
+    brush: ?*Brush, // null when grouping by volumes
+    _pad0: [3]*const anyopaque,
+    _pad1: [3]*const anyopaque,
+    changed: bool,
+    _pad2: [2]i32,
+
+    comptime { std.debug.assert(@sizeOf(@This()) == @sizeOf(c.CCSG_MeshGroup)); }
+
+    pub fn getVertices(group: *const MeshGroup) []const MeshVertex {
+        var ptr: [*c]MeshVertex = null;
+        const len = c.CCSG_MeshGroup_GetVerticesPtr(
+            @as(*const c.CCSG_MeshGroup, @ptrCast(group)),
+            @as([*c][*c] c.CCSG_MeshVertex, @ptrCast(&ptr)),
+        );
+        if (ptr) |array| {
+            return array[0..len];
+        }
+        return &.{};
+    }
+    pub fn getIndices(group: *const MeshGroup) []const u32 {
+        var ptr: [*c]u32 = null;
+        const len = c.CCSG_MeshGroup_GetIndicesPtr(@as(*const c.CCSG_MeshGroup, @ptrCast(group)), &ptr);
+        if (ptr) |array| {
+            return array[0..len];
+        }
+        return &.{};
+    }
+};
+
+pub const PackedVertex = extern struct {
+    position: [3]u16, // quantized within the box of the chunk
+    normal: [2]i8,    // octahedral encoding
+
+    comptime { std.debug.assert(@sizeOf(@This()) == @sizeOf(c.CCSG_PackedVertex)); }
+};
+
+pub const PackedChunk = extern struct {
+    group: i32, // index into Mesh.getGroups
+    box: Box,
+    first_vertex: u32,
+    vertex_count: u32,
+    first_index: u32,
+    index_count: u32, // 16 bit indices relative to first_vertex
+
+    comptime { std.debug.assert(@sizeOf(@This()) == @sizeOf(c.CCSG_PackedChunk)); }
+
+    pub fn unpack(chunk: *const PackedChunk, vertex: PackedVertex, position: *Vec3, normal: *Vec3) void {
+        c.CCSG_UnpackVertex(
+            @as(*const c.CCSG_PackedChunk, @ptrCast(chunk)),
+            @as(*const c.CCSG_PackedVertex, @ptrCast(&vertex)),
+            @as(*c.CCSG_Vec3, @ptrCast(position)),
+            @as(*c.CCSG_Vec3, @ptrCast(normal)),
+        );
+    }
+};
+
 //--------------------------------------------------------------------------------------------------
 // VolumeOperation
 //--------------------------------------------------------------------------------------------------
@@ -239,6 +339,10 @@ pub const World = opaque {
     pub fn deinit(world: *World) void {
         c.CCSG_World_Destroy(@as(*c.CCSG_World, @ptrCast(world)));
     }
+    // the copy is owned by the caller, free it with deinit
+    pub fn clone(world: *const World) *World {
+        return @as(*World, @ptrCast(c.CCSG_World_Clone(@as(*const c.CCSG_World, @ptrCast(world)))));
+    }
 
     pub fn first(world: *World) ?*Brush {
         const result = c.CCSG_World_First(@as(*c.CCSG_World, @ptrCast(world)));
@@ -255,34 +359,279 @@ pub const World = opaque {
         return @as(*Brush, @ptrCast(c.CCSG_World_Add(@as(*c.CCSG_World, @ptrCast(world)))));
     }
 
-    pub fn rebuild(world: *World) *BrushSet {
-        return @as(*BrushSet, @ptrCast(c.CCSG_World_Rebuild(@as(*c.CCSG_World, @ptrCast(world)))));
+    // adds plane_counts.len brushes at once, brush i takes the next
+    // plane_counts[i] planes. null operations keep the identity
+    pub fn addMany(
+        world: *World,
+        planes: []const Plane,
+        plane_counts: []const i32,
+        operations: ?[]const ?*const VolumeOperation,
+        times: ?[]const i32,
+        out_brushes: ?[]*Brush,
+    ) void {
+        if (operations) |ops| std.debug.assert(ops.len == plane_counts.len);
+        if (times) |t| std.debug.assert(t.len == plane_counts.len);
+        if (out_brushes) |b| std.debug.assert(b.len == plane_counts.len);
+        c.CCSG_World_AddMany(
+            @as(*c.CCSG_World, @ptrCast(world)),
+            plane_counts.len,
+            @as([*c]const c.CCSG_Plane, @ptrCast(planes.ptr)),
+            @as([*c]const c_int, @ptrCast(plane_counts.ptr)),
+            if (operations) |ops| @as([*c]const [*c]const c.CCSG_VolumeOperation, @ptrCast(ops.ptr)) else null,
+            if (times) |t| @as([*c]const c_int, @ptrCast(t.ptr)) else null,
+            if (out_brushes) |b| @as([*c][*c]c.CCSG_Brush, @ptrCast(b.ptr)) else null,
+        );
     }
 
-    pub fn queryPoint(world: *World, point: Vec3) *BrushList {
-        return @as(*BrushList, @ptrCast(c.CCSG_World_QueryPoint(
+    pub fn addShape(world: *World, planes: []const Plane) *Shape {
+        return @as(*Shape, @ptrCast(c.CCSG_World_AddShape(
+            @as(*c.CCSG_World, @ptrCast(world)),
+            @as(*const c.CCSG_Plane, @ptrCast(planes.ptr)),
+            planes.len,
+        )));
+    }
+    pub fn removeShape(world: *World, shape: *Shape) void {
+        c.CCSG_World_RemoveShape(@as(*c.CCSG_World, @ptrCast(world)), @as(*c.CCSG_Shape, @ptrCast(shape)));
+    }
+
+    pub fn beginEdit(world: *World) void {
+        c.CCSG_World_BeginEdit(@as(*c.CCSG_World, @ptrCast(world)));
+    }
+    pub fn endEdit(world: *World) void {
+        c.CCSG_World_EndEdit(@as(*c.CCSG_World, @ptrCast(world)));
+    }
+
+    pub fn getPlane(world: *const World, plane_id: i32) *const Plane {
+        return @as(*const Plane, @ptrCast(c.CCSG_World_GetPlane(@as(*const c.CCSG_World, @ptrCast(world)), plane_id)));
+    }
+
+    // the slice is owned by the world and valid until the next rebuild
+    pub fn rebuild(world: *World) []const Change {
+        var ptr: [*c]Change = null;
+        const len = c.CCSG_World_Rebuild(
             @as(*c.CCSG_World, @ptrCast(world)),
+            @as([*c][*c] c.CCSG_Change, @ptrCast(&ptr)),
+        );
+        if (ptr) |array| {
+            return array[0..len];
+        }
+        return &.{};
+    }
+
+    pub fn setTrackFragmentChanges(world: *World, enabled: bool) void {
+        c.CCSG_World_SetTrackFragmentChanges(@as(*c.CCSG_World, @ptrCast(world)), @intFromBool(enabled));
+    }
+
+    // the slice is owned by the world and valid until the next rebuild
+    pub fn getFragmentChanges(world: *const World) []const FragmentChange {
+        var ptr: [*c]FragmentChange = null;
+        const len = c.CCSG_World_GetFragmentChanges(
+            @as(*const c.CCSG_World, @ptrCast(world)),
+            @as([*c][*c] c.CCSG_FragmentChange, @ptrCast(&ptr)),
+        );
+        if (ptr) |array| {
+            return array[0..len];
+        }
+        return &.{};
+    }
+
+    // safe to call from several threads at once while nothing edits the world
+    pub fn queryPoint(world: *const World, point: Vec3) *BrushList {
+        return @as(*BrushList, @ptrCast(c.CCSG_World_QueryPoint(
+            @as(*const c.CCSG_World, @ptrCast(world)),
             @as(*const c.CCSG_Vec3, @ptrCast(&point)),
         )));
     }
-    pub fn queryBox(world: *World, box: Box) *BrushList {
+    pub fn queryBox(world: *const World, box: Box) *BrushList {
         return @as(*BrushList, @ptrCast(c.CCSG_World_QueryBox(
-            @as(*c.CCSG_World, @ptrCast(world)),
+            @as(*const c.CCSG_World, @ptrCast(world)),
             @as(*const c.CCSG_Box, @ptrCast(&box)),
         )));
     }
-    pub fn queryRay(world: *World, ray: Ray) *RayHitList {
+    pub fn queryRay(world: *const World, ray: Ray) *RayHitList {
         return @as(*RayHitList, @ptrCast(c.CCSG_World_QueryRay(
-            @as(*c.CCSG_World, @ptrCast(world)),
+            @as(*const c.CCSG_World, @ptrCast(world)),
             @as(*const c.CCSG_Ray, @ptrCast(&ray)),
         )));
     }
-    pub fn qeryFrustum(world: *World, view_projection: Mat4) *BrushList {
+    pub fn qeryFrustum(world: *const World, view_projection: Mat4) *BrushList {
         return @as(*BrushList, @ptrCast(c.CCSG_World_QueryFrustum(
-            @as(*c.CCSG_World, @ptrCast(world)),
+            @as(*const c.CCSG_World, @ptrCast(world)),
             @as(*const c.CCSG_Mat4, @ptrCast(&view_projection)),
         )));
     }
+    pub fn queryVolume(world: *const World, point: Vec3) Volume {
+        return c.CCSG_World_QueryVolume(
+            @as(*const c.CCSG_World, @ptrCast(world)),
+            @as(*const c.CCSG_Vec3, @ptrCast(&point)),
+        );
+    }
+    pub fn queryVolumes(world: *const World, points: []const Vec3, out_volumes: []Volume) void {
+        std.debug.assert(points.len == out_volumes.len);
+        c.CCSG_World_QueryVolumes(
+            @as(*const c.CCSG_World, @ptrCast(world)),
+            @as([*c]const c.CCSG_Vec3, @ptrCast(points.ptr)),
+            points.len,
+            @as([*c]c.CCSG_Volume, @ptrCast(out_volumes.ptr)),
+        );
+    }
+
+    // null for brushes with custom volume operations, and with
+    // Snapshot.computed for worlds changed since the last rebuild
+    pub fn saveSnapshot(world: *World, flags: i32) ?*ByteList {
+        const result = c.CCSG_World_SaveSnapshot(@as(*c.CCSG_World, @ptrCast(world)), flags);
+        return if (result == null) null else @as(*ByteList, @ptrCast(result));
+    }
+    // the world must be empty, data is only read during the call
+    pub fn loadSnapshot(world: *World, data: []align(8) const u8) bool {
+        return c.CCSG_World_LoadSnapshot(@as(*c.CCSG_World, @ptrCast(world)), data.ptr, data.len);
+    }
+    // adds the brushes of a .map file, false on parse errors
+    pub fn importMap(world: *World, text: []const u8) bool {
+        return c.CCSG_World_ImportMap(@as(*c.CCSG_World, @ptrCast(world)), text.ptr, text.len);
+    }
+};
+
+pub const Snapshot = struct {
+    pub const computed: i32 = c.CCSG_SNAPSHOT_COMPUTED;
+};
+
+//--------------------------------------------------------------------------------------------------
+// Shape
+//--------------------------------------------------------------------------------------------------
+pub const Shape = opaque {
+    pub fn getPlanes(shape: *const Shape) ?[]const Plane {
+        const vec = c.CCSG_Shape_GetPlanes(@as(*const c.CCSG_Shape, @ptrCast(shape))) orelse return null;
+        var ptr: [*c]Plane = null;
+        const len = c.CCSG_PlaneVec_GetPtr(vec, @as([*c][*c] c.CCSG_Plane, @ptrCast(&ptr)));
+        if (ptr) |array| {
+            return array[0..len];
+        }
+        return null;
+    }
+};
+
+//--------------------------------------------------------------------------------------------------
+// Mesh
+//--------------------------------------------------------------------------------------------------
+pub const MeshGrouping = enum(i32) {
+    by_volumes = c.CCSG_MESH_GROUP_BY_VOLUMES,
+    by_brush = c.CCSG_MESH_GROUP_BY_BRUSH,
+};
+
+pub const MeshTriangulation = enum(i32) {
+    strip = c.CCSG_MESH_TRIANGULATE_STRIP,
+    min_weight = c.CCSG_MESH_TRIANGULATE_MIN_WEIGHT,
+};
+
+pub const Mesh = opaque {
+    pub fn init(grouping: MeshGrouping) *Mesh {
+        return @as(*Mesh, @ptrCast(c.CCSG_Mesh_Create(@intFromEnum(grouping))));
+    }
+    pub fn deinit(mesh: *Mesh) void {
+        c.CCSG_Mesh_Destroy(@as(*c.CCSG_Mesh, @ptrCast(mesh)));
+    }
+
+    pub fn setOutsideVolume(mesh: *Mesh, outside_volume: Volume) void {
+        c.CCSG_Mesh_SetOutsideVolume(@as(*c.CCSG_Mesh, @ptrCast(mesh)), outside_volume);
+    }
+    pub fn setTriangulation(mesh: *Mesh, triangulation: MeshTriangulation) void {
+        c.CCSG_Mesh_SetTriangulation(@as(*c.CCSG_Mesh, @ptrCast(mesh)), @intFromEnum(triangulation));
+    }
+    pub fn setOptimizeVertexCache(mesh: *Mesh, enabled: bool) void {
+        c.CCSG_Mesh_SetOptimizeVertexCache(@as(*c.CCSG_Mesh, @ptrCast(mesh)), @intFromBool(enabled));
+    }
+    pub fn build(mesh: *Mesh, world: *World) void {
+        c.CCSG_Mesh_Build(@as(*c.CCSG_Mesh, @ptrCast(mesh)), @as(*c.CCSG_World, @ptrCast(world)));
+    }
+    // changes as returned by World.rebuild
+    pub fn update(mesh: *Mesh, changes: []const Change) void {
+        c.CCSG_Mesh_Update(
+            @as(*c.CCSG_Mesh, @ptrCast(mesh)),
+            @as([*c]const c.CCSG_Change, @ptrCast(changes.ptr)),
+            changes.len,
+        );
+    }
+
+    // the slice is owned by the mesh and valid until the next build or update
+    pub fn getGroups(mesh: *const Mesh) []const MeshGroup {
+        var ptr: [*c]MeshGroup = null;
+        const len = c.CCSG_Mesh_GetGroups(
+            @as(*const c.CCSG_Mesh, @ptrCast(mesh)),
+            @as([*c][*c] c.CCSG_MeshGroup, @ptrCast(&ptr)),
+        );
+        if (ptr) |array| {
+            return array[0..len];
+        }
+        return &.{};
+    }
+
+    pub fn getVertexCount(mesh: *const Mesh) usize {
+        return c.CCSG_Mesh_GetVertexCount(@as(*const c.CCSG_Mesh, @ptrCast(mesh)));
+    }
+    pub fn getIndexCount(mesh: *const Mesh) usize {
+        return c.CCSG_Mesh_GetIndexCount(@as(*const c.CCSG_Mesh, @ptrCast(mesh)));
+    }
+
+    // chunk_size 0 splits groups only where they have more than 65536 vertices
+    pub fn pack(mesh: *const Mesh, packed_mesh: *PackedMesh, chunk_size: Scalar) void {
+        c.CCSG_Mesh_Pack(
+            @as(*const c.CCSG_Mesh, @ptrCast(mesh)),
+            @as(*c.CCSG_PackedMesh, @ptrCast(packed_mesh)),
+            chunk_size,
+        );
+    }
+
+    // vertices and indices need getVertexCount() and getIndexCount() elements
+    pub fn write(mesh: *const Mesh, vertices: []MeshVertex, indices: []u32) void {
+        std.debug.assert(vertices.len >= mesh.getVertexCount() and indices.len >= mesh.getIndexCount());
+        c.CCSG_Mesh_Write(
+            @as(*const c.CCSG_Mesh, @ptrCast(mesh)),
+            @as([*c]c.CCSG_MeshVertex, @ptrCast(vertices.ptr)),
+            indices.ptr,
+        );
+    }
+};
+
+pub const PackedMesh = opaque {
+    pub fn init() *PackedMesh {
+        return @as(*PackedMesh, @ptrCast(c.CCSG_PackedMesh_Create()));
+    }
+    pub fn deinit(packed_mesh: *PackedMesh) void {
+        c.CCSG_PackedMesh_Destroy(@as(*c.CCSG_PackedMesh, @ptrCast(packed_mesh)));
+    }
+
+    // the slices are owned by the packed mesh and valid until the next pack
+    pub fn getVertices(packed_mesh: *const PackedMesh) []const PackedVertex {
+        var ptr: [*c]PackedVertex = null;
+        const len = c.CCSG_PackedMesh_GetVertices(
+            @as(*const c.CCSG_PackedMesh, @ptrCast(packed_mesh)),
+            @as([*c][*c] c.CCSG_PackedVertex, @ptrCast(&ptr)),
+        );
+        if (ptr) |array| {
+            return array[0..len];
+        }
+        return &.{};
+    }
+    pub fn getIndices(packed_mesh: *const PackedMesh) []const u16 {
+        var ptr: [*c]u16 = null;
+        const len = c.CCSG_PackedMesh_GetIndices(@as(*const c.CCSG_PackedMesh, @ptrCast(packed_mesh)), &ptr);
+        if (ptr) |array| {
+            return array[0..len];
+        }
+        return &.{};
+    }
+    pub fn getChunks(packed_mesh: *const PackedMesh) []const PackedChunk {
+        var ptr: [*c]PackedChunk = null;
+        const len = c.CCSG_PackedMesh_GetChunks(
+            @as(*const c.CCSG_PackedMesh, @ptrCast(packed_mesh)),
+            @as([*c][*c] c.CCSG_PackedChunk, @ptrCast(&ptr)),
+        );
+        if (ptr) |array| {
+            return array[0..len];
+        }
+        return &.{};
+    }
 };
 
 //--------------------------------------------------------------------------------------------------
@@ -307,6 +656,37 @@ pub const Brush = opaque {
         return null;
     }
 
+    pub fn setShape(brush: *Brush, shape: *Shape) void {
+        c.CCSG_Brush_SetShape(@as(*c.CCSG_Brush, @ptrCast(brush)), @as(*c.CCSG_Shape, @ptrCast(shape)));
+    }
+
+    pub fn getShape(brush: *const Brush) ?*Shape {
+        return @as(?*Shape, @ptrCast(c.CCSG_Brush_GetShape(@as(*const c.CCSG_Brush, @ptrCast(brush)))));
+    }
+
+    pub fn setTransform(brush: *Brush, transform: Mat4) void {
+        c.CCSG_Brush_SetTransform(
+            @as(*c.CCSG_Brush, @ptrCast(brush)),
+            @as(*const c.CCSG_Mat4, @ptrCast(&transform)),
+        );
+    }
+
+    pub fn getTransform(brush: *const Brush) Mat4 {
+        var transform: Mat4 = undefined;
+        c.CCSG_Brush_GetTransform(
+            @as(*const c.CCSG_Brush, @ptrCast(brush)),
+            @as(*c.CCSG_Mat4, @ptrCast(&transform)),
+        );
+        return transform;
+    }
+
+    pub fn translate(brush: *Brush, offset: Vec3) void {
+        c.CCSG_Brush_Translate(
+            @as(*c.CCSG_Brush, @ptrCast(brush)),
+            @as(*const c.CCSG_Vec3, @ptrCast(&offset)),
+        );
+    }
+
     pub fn setVolumeOperation(brush: *Brush, op: *const VolumeOperation) void {
         c.CCSG_Brush_SetVolumeOperation(
             @as(*c.CCSG_Brush, @ptrCast(brush)),
@@ -344,30 +724,6 @@ pub const Brush = opaque {
 //--------------------------------------------------------------------------------------------------
 // STL Container Wrappers
 //--------------------------------------------------------------------------------------------------
-pub const BrushSet = opaque {
-    pub fn deinit(set: *BrushSet) void {
-        c.CCSG_BrushSet_Destroy(@as(*c.CCSG_BrushSet, @ptrCast(set)));
-    }
-    pub fn iterator(set: *BrushSet) *Iterator {
-        return @as(*Iterator, @ptrCast(c.CCSG_BrushSet_Iterator_Begin(@as(*c.CCSG_BrushSet, @ptrCast(set)))));
-    }
-
-    pub const Iterator = opaque {
-        pub fn deinit(self: *Iterator) void {
-            c.CCSG_BrushSet_Iterator_Destroy(@as(*c.CCSG_BrushSet_Iterator, @ptrCast(self)));
-        }
-        pub fn next(self: *Iterator, set: *BrushSet) ?*const Brush {
-            const current = c.CCSG_BrushSet_Iterator_Read(@as(*const c.CCSG_BrushSet_Iterator, @ptrCast(self)));
-            const exists = c.CCSG_BrushSet_Iterator_Next(
-                @as(*c.CCSG_BrushSet, @ptrCast(set)),
-                @as(*c.CCSG_BrushSet_Iterator, @ptrCast(self)),
-            );
-            if (exists == 0) return null;
-            return @as(*const Brush, @ptrCast(current));
-        }
-    };
-};
-
 pub const BrushList = opaque {
     pub fn deinit(list: *BrushList) void {
         c.CCSG_BrushVec_Destroy(@as(*c.CCSG_BrushVec, @ptrCast(list)));
@@ -419,6 +775,20 @@ pub const TriangleList = opaque {
     }
 };
 
+pub const ByteList = opaque {
+    pub fn deinit(list: *ByteList) void {
+        c.CCSG_ByteVec_Destroy(@as(*c.CCSG_ByteVec, @ptrCast(list)));
+    }
+    pub fn getSlice(list: *ByteList) ?[]align(8) const u8 {
+        var ptr: [*c]const u8 = null;
+        const len = c.CCSG_ByteVec_GetPtr(@as(*const c.CCSG_ByteVec, @ptrCast(list)), &ptr);
+        if (ptr) |array| {
+            return @alignCast(array[0..len]);
+        }
+        return null;
+    }
+};
+
 //--------------------------------------------------------------------------------------------------
 // Misc.
 //--------------------------------------------------------------------------------------------------
@@ -426,6 +796,64 @@ pub fn triangulate(fragment: *const Fragment) *TriangleList {
     return @as(*TriangleList, @ptrCast(c.CCSG_Triangulate(@as(*const c.CCSG_Fragment, @ptrCast(fragment)))));
 }
 
+pub fn triangleCount(fragment: *const Fragment) usize {
+    return @as(usize, @intCast(c.CCSG_TriangleCount(@as(*const c.CCSG_Fragment, @ptrCast(fragment)))));
+}
+
+// out needs triangleCount(fragment) elements, returns the written part
+pub fn triangulateInto(fragment: *const Fragment, out: []Triangle) []Triangle {
+    std.debug.assert(out.len >= triangleCount(fragment));
+    const len = c.CCSG_TriangulateInto(
+        @as(*const c.CCSG_Fragment, @ptrCast(fragment)),
+        @as([*c]c.CCSG_Triangle, @ptrCast(out.ptr)),
+    );
+    return out[0..@as(usize, @intCast(len))];
+}
+
+// triangles of every fragment of a brush or world, fragment i has the
+// triangles from getOffsets()[i] up to getOffsets()[i+1]
+pub const Triangulation = opaque {
+    pub fn init() *Triangulation {
+        return @as(*Triangulation, @ptrCast(c.CCSG_Triangulation_Create()));
+    }
+    pub fn deinit(triangulation: *Triangulation) void {
+        c.CCSG_Triangulation_Destroy(@as(*c.CCSG_Triangulation, @ptrCast(triangulation)));
+    }
+
+    pub fn brush(triangulation: *Triangulation, csg_brush: *const Brush) void {
+        c.CCSG_TriangulateBrush(
+            @as(*const c.CCSG_Brush, @ptrCast(csg_brush)),
+            @as(*c.CCSG_Triangulation, @ptrCast(triangulation)),
+        );
+    }
+    pub fn world(triangulation: *Triangulation, csg_world: *World) void {
+        c.CCSG_TriangulateWorld(
+            @as(*c.CCSG_World, @ptrCast(csg_world)),
+            @as(*c.CCSG_Triangulation, @ptrCast(triangulation)),
+        );
+    }
+
+    pub fn getTriangles(triangulation: *const Triangulation) []const Triangle {
+        var ptr: [*c]Triangle = null;
+        const len = c.CCSG_Triangulation_GetTriangles(
+            @as(*const c.CCSG_Triangulation, @ptrCast(triangulation)),
+            @as([*c][*c] c.CCSG_Triangle, @ptrCast(&ptr)),
+        );
+        if (ptr) |array| {
+            return array[0..len];
+        }
+        return &.{};
+    }
+    pub fn getOffsets(triangulation: *const Triangulation) []const u32 {
+        var ptr: [*c]u32 = null;
+        const len = c.CCSG_Triangulation_GetOffsets(@as(*const c.CCSG_Triangulation, @ptrCast(triangulation)), &ptr);
+        if (ptr) |array| {
+            return array[0..len];
+        }
+        return &.{};
+    }
+};
+
 //--------------------------------------------------------------------------------------------------
 // Tests
 //--------------------------------------------------------------------------------------------------
@@ -494,18 +922,17 @@ test "square_torus" {
     };
     brush_1.setPlanes(&planes_1);
 
-    const changed_brushes = csg_world.rebuild();
-    defer changed_brushes.deinit();
+    const changes = csg_world.rebuild();
 
-    var points = std.ArrayList([3]f32).init(std.testing.allocator);
+    var points = std.ArrayList(Vec3).init(std.testing.allocator);
     defer points.deinit();
 
     var indices = std.ArrayList(u32).init(std.testing.allocator);
     defer indices.deinit();
 
-    const brush_iterator = changed_brushes.iterator();
-    defer brush_iterator.deinit();
-    while (brush_iterator.next(changed_brushes)) |brush| {
+    for (changes) |change| {
+        if ((change.kinds & Change.fragments) == 0) continue;
+        const brush = change.brush;
         const faces = brush.getFaces() orelse continue;
         for (faces) |face| {
             const fragments = face.getFragments() orelse continue;
@@ -537,4 +964,285 @@ test "square_torus" {
 
     try expect(points.items.len == 64);
     try expect(indices.items.len == 96);
+}
+
+test "shape_instances" {
+    if (options.use_custom_alloc) try init_allocator(std.testing.allocator);
+    defer { if (options.use_custom_alloc) deinit_allocator(); }
+
+    const solid_volume_op = VolumeOperation.initFill(1);
+    defer solid_volume_op.deinit();
+
+    const csg_world = World.init();
+    defer csg_world.deinit();
+
+    const shape = csg_world.addShape(&[6]Plane{
+        .{ .normal = .{ 0, 0, 1 }, .offset = -30 },
+        .{ .normal = .{ 0, 0, -1 }, .offset = 20 },
+        .{ .normal = .{ 1, 0, 0 }, .offset = -10 },
+        .{ .normal = .{ -1, 0, 0 }, .offset = -10 },
+        .{ .normal = .{ 0, 1, 0 }, .offset = -10 },
+        .{ .normal = .{ 0, -1, 0 }, .offset = -10 },
+    });
+
+    // all instances are placed before the first rebuild, the faces are
+    // built for the first one and moved for the others
+    const instance_count = 10;
+    for (0..instance_count) |i| {
+        const brush = csg_world.add();
+        brush.setVolumeOperation(solid_volume_op);
+        brush.setShape(shape);
+        brush.translate(.{ @as(Scalar, @floatFromInt(i)) * 30, 0, 0 });
+    }
+
+    var built: usize = 0;
+    var moved: usize = 0;
+    const changes = csg_world.rebuild();
+    try expect(changes.len == instance_count);
+    for (changes) |change| {
+        try expect((change.kinds & Change.faces) != 0);
+        if ((change.kinds & Change.moved) != 0) moved += 1 else built += 1;
+    }
+    if (options.use_exact_planes) {
+        // transformed exact planes are snapped, faces are always built
+        try expect(built == instance_count);
+    } else {
+        try expect(built == 1);
+        try expect(moved == instance_count - 1);
+    }
+}
+
+test "shape_instances_snapshot" {
+    if (options.use_custom_alloc) try init_allocator(std.testing.allocator);
+    defer { if (options.use_custom_alloc) deinit_allocator(); }
+
+    const solid_volume_op = VolumeOperation.initFill(1);
+    defer solid_volume_op.deinit();
+
+    const csg_world = World.init();
+    defer csg_world.deinit();
+
+    const shape = csg_world.addShape(&[6]Plane{
+        .{ .normal = .{ 0, 0, 1 }, .offset = -30 },
+        .{ .normal = .{ 0, 0, -1 }, .offset = 20 },
+        .{ .normal = .{ 1, 0, 0 }, .offset = -10 },
+        .{ .normal = .{ -1, 0, 0 }, .offset = -10 },
+        .{ .normal = .{ 0, 1, 0 }, .offset = -10 },
+        .{ .normal = .{ 0, -1, 0 }, .offset = -10 },
+    });
+    for (0..3) |i| {
+        const brush = csg_world.add();
+        brush.setVolumeOperation(solid_volume_op);
+        brush.setShape(shape);
+        brush.translate(.{ @as(Scalar, @floatFromInt(i)) * 15, 0, 0 });
+    }
+    _ = csg_world.rebuild();
+
+    const snapshot = csg_world.saveSnapshot(Snapshot.computed) orelse return error.TestUnexpectedResult;
+    defer snapshot.deinit();
+    const data = snapshot.getSlice() orelse return error.TestUnexpectedResult;
+
+    const loaded = World.init();
+    defer loaded.deinit();
+    try expect(loaded.loadSnapshot(data));
+    try expect(loaded.rebuild().len == 0);
+
+    // the brushes are still placed with one shape, at the same transforms
+    var original = csg_world.first();
+    var brush = loaded.first();
+    const loaded_shape = brush.?.getShape() orelse return error.TestUnexpectedResult;
+    while (brush) |b| : ({
+        brush = loaded.next(b);
+        original = csg_world.next(original.?);
+    }) {
+        try expect(b.getShape() == loaded_shape);
+        try expect(std.mem.eql(Scalar, &b.getTransform(), &original.?.getTransform()));
+    }
+    try expect(original == null);
+}
+
+// the square torus of the "square_torus" test, a solid block with a hole
+// through it, as the planes of its two brushes one after another
+const square_torus_planes = [12]Plane{
+    .{ .normal = .{ 0, 0, 1 }, .offset = -30 },
+    .{ .normal = .{ 0, 0, -1 }, .offset = 20 },
+    .{ .normal = .{ 1, 0, 0 }, .offset = -10 },
+    .{ .normal = .{ -1, 0, 0 }, .offset = -10 },
+    .{ .normal = .{ 0, 1, 0 }, .offset = -10 },
+    .{ .normal = .{ 0, -1, 0 }, .offset = -10 },
+    .{ .normal = .{ 0, 0, 1 }, .offset = -30 },
+    .{ .normal = .{ 0, 0, -1 }, .offset = 20 },
+    .{ .normal = .{ 1, 0, 0 }, .offset = -5 },
+    .{ .normal = .{ -1, 0, 0 }, .offset = -5 },
+    .{ .normal = .{ 0, 1, 0 }, .offset = -5 },
+    .{ .normal = .{ 0, -1, 0 }, .offset = -5 },
+};
+
+// a world with the square torus added (solid brush first, then the hole)
+// but not rebuilt yet. sets up the allocator, deinit tears it all down
+const SquareTorus = struct {
+    space_volume_op: *VolumeOperation,
+    solid_volume_op: *VolumeOperation,
+    world: *World,
+    brushes: [2]*Brush,
+
+    fn init() !SquareTorus {
+        if (options.use_custom_alloc) try init_allocator(std.testing.allocator);
+        var torus: SquareTorus = undefined;
+        torus.space_volume_op = VolumeOperation.initFill(0);
+        torus.solid_volume_op = VolumeOperation.initFill(1);
+        torus.world = World.init();
+        const plane_counts = [2]i32{ 6, 6 };
+        const operations = [2]?*const VolumeOperation{ torus.solid_volume_op, torus.space_volume_op };
+        const times = [2]i32{ 0, 1 };
+        torus.world.addMany(&square_torus_planes, &plane_counts, &operations, &times, &torus.brushes);
+        return torus;
+    }
+
+    fn deinit(torus: SquareTorus) void {
+        torus.world.deinit();
+        torus.solid_volume_op.deinit();
+        torus.space_volume_op.deinit();
+        if (options.use_custom_alloc) deinit_allocator();
+    }
+};
+
+// the rebuilt square torus meshed by volumes, 64 fragment vertices
+// welded within each face
+fn expectSquareTorusMesh(world: *World) !void {
+    const mesh = Mesh.init(.by_volumes);
+    defer mesh.deinit();
+    mesh.setOutsideVolume(0);
+    mesh.build(world);
+    try expect(mesh.getVertexCount() == 56);
+    try expect(mesh.getIndexCount() == 96);
+}
+
+test "square_torus_mesh" {
+    const torus = try SquareTorus.init();
+    defer torus.deinit();
+
+    const mesh = Mesh.init(.by_volumes);
+    defer mesh.deinit();
+    mesh.setOutsideVolume(0);
+
+    _ = torus.world.rebuild();
+    mesh.build(torus.world);
+
+    const groups = mesh.getGroups();
+    try expect(groups.len == 1);
+    try expect(groups[0].front_volume == 0 and groups[0].back_volume == 1);
+    // 64 fragment vertices, welded within each face
+    try expect(groups[0].getVertices().len == 56);
+    try expect(groups[0].getIndices().len == 96);
+
+    // moving the hole in the same volume keeps the counts
+    torus.brushes[1].translate(.{ 1, 0, 0 });
+    mesh.update(torus.world.rebuild());
+    try expect(mesh.getGroups()[0].changed);
+    try expect(mesh.getVertexCount() == 56);
+    try expect(mesh.getIndexCount() == 96);
+}
+
+test "square_torus_snapshot" {
+    const torus = try SquareTorus.init();
+    defer torus.deinit();
+
+    // computed data can only be saved right after a rebuild
+    try expect(torus.world.saveSnapshot(Snapshot.computed) == null);
+    _ = torus.world.rebuild();
+
+    const snapshot = torus.world.saveSnapshot(Snapshot.computed) orelse return error.TestUnexpectedResult;
+    defer snapshot.deinit();
+    const data = snapshot.getSlice() orelse return error.TestUnexpectedResult;
+
+    const loaded = World.init();
+    defer loaded.deinit();
+    try expect(loaded.loadSnapshot(data));
+    try expect(!loaded.loadSnapshot(data));
+
+    // the faces come with the snapshot, nothing is left to rebuild
+    try expect(loaded.rebuild().len == 0);
+    try expectSquareTorusMesh(loaded);
+}
+
+test "square_torus_add_many" {
+    const torus = try SquareTorus.init();
+    defer torus.deinit();
+
+    // SquareTorus adds its brushes with addMany
+    try expect(torus.world.first() == torus.brushes[0]);
+    try expect(torus.world.next(torus.brushes[0]) == torus.brushes[1]);
+    try expect(torus.world.rebuild().len == 2);
+    try expectSquareTorusMesh(torus.world);
+}
+
+test "square_torus_clone" {
+    const torus = try SquareTorus.init();
+    defer torus.deinit();
+    _ = torus.world.rebuild();
+
+    const copy = torus.world.clone();
+    defer copy.deinit();
+
+    // the faces come with the copy, nothing is left to rebuild
+    try expect(copy.rebuild().len == 0);
+    try expectSquareTorusMesh(copy);
+}
+
+test "square_torus_query_volume" {
+    const torus = try SquareTorus.init();
+    defer torus.deinit();
+    _ = torus.world.rebuild();
+
+    // in the hole, in the torus and outside of both
+    const points = [3]Vec3{ .{ 0, 0, 25 }, .{ 7, 0, 25 }, .{ 20, 0, 25 } };
+    try expect(torus.world.queryVolume(points[0]) == 0);
+    try expect(torus.world.queryVolume(points[1]) == 1);
+    try expect(torus.world.queryVolume(points[2]) == 0);
+
+    var volumes: [3]Volume = undefined;
+    torus.world.queryVolumes(&points, &volumes);
+    try expect(volumes[0] == 0);
+    try expect(volumes[1] == 1);
+    try expect(volumes[2] == 0);
+}
+
+test "map_import_comments" {
+    if (options.use_custom_alloc) try init_allocator(std.testing.allocator);
+    defer { if (options.use_custom_alloc) deinit_allocator(); }
+
+    const csg_world = World.init();
+    defer csg_world.deinit();
+
+    // a '}' in a comment or a texture name doesn't end the brush
+    const map =
+        \\{
+        \\"classname" "worldspawn"
+        \\{
+        \\( 0 0 0 ) ( 0 1 0 ) ( 1 0 0 ) {clip 0 0 0 1 1
+        \\// top }
+        \\( 0 0 64 ) ( 1 0 64 ) ( 0 1 64 ) }weird 0 0 0 1 1
+        \\( 0 0 0 ) ( 0 0 1 ) ( 0 1 0 ) base 0 0 0 1 1
+        \\( 64 0 0 ) ( 64 1 0 ) ( 64 0 1 ) base 0 0 0 1 1
+        \\( 0 0 0 ) ( 1 0 0 ) ( 0 0 1 ) base 0 0 0 1 1
+        \\( 0 64 0 ) ( 0 64 1 ) ( 1 64 0 ) base 0 0 0 1 1
+        \\}
+        \\{
+        \\( 128 0 0 ) ( 128 1 0 ) ( 129 0 0 ) base 0 0 0 1 1
+        \\( 128 0 64 ) ( 129 0 64 ) ( 128 1 64 ) base 0 0 0 1 1
+        \\( 128 0 0 ) ( 128 0 1 ) ( 128 1 0 ) base 0 0 0 1 1
+        \\( 192 0 0 ) ( 192 1 0 ) ( 192 0 1 ) base 0 0 0 1 1
+        \\( 128 0 0 ) ( 129 0 0 ) ( 128 0 1 ) base 0 0 0 1 1
+        \\( 128 64 0 ) ( 128 64 1 ) ( 129 64 0 ) base 0 0 0 1 1
+        \\}
+        \\}
+    ;
+    try expect(csg_world.importMap(map));
+
+    const brush_0 = csg_world.first() orelse return error.TestUnexpectedResult;
+    const brush_1 = csg_world.next(brush_0) orelse return error.TestUnexpectedResult;
+    try expect(csg_world.next(brush_1) == null);
+    try expect(brush_0.getPlanes().?.len == 6);
+    try expect(brush_1.getPlanes().?.len == 6);
 }
\ No newline at end of file
@@ -10,6 +10,16 @@ pub fn build(b: *std.Build) void {
             "use_custom_alloc",
             "Replace the new and delete operators for C++",
         ) orelse true,
+        .use_double_precision = b.option(
+            bool,
+            "use_double_precision",
+            "Build the csg library with double precision geometry",
+        ) orelse false,
+        .use_exact_planes = b.option(
+            bool,
+            "use_exact_planes",
+            "Snap planes to a grid and use exact predicates in the csg library",
+        ) orelse false,
     };
 
     const options_step = b.addOptions();
@@ -37,6 +47,8 @@ pub fn build(b: *std.Build) void {
     b.installArtifact(ccsg);
 
     if (options.use_custom_alloc) ccsg.defineCMacro("CSG_CUSTOM_ALLOCATOR_HEADER", "\"bindings/c/ccsg_memory.hpp\"");
+    if (options.use_double_precision) ccsg.defineCMacro("CSG_SCALAR", "double");
+    if (options.use_exact_planes) ccsg.defineCMacro("CSG_EXACT_PLANES", null);
     ccsg.addIncludePath(b.path("./"));
     ccsg.addIncludePath(b.path("3rdp/glm"));
     ccsg.linkLibC();
@@ -46,12 +58,22 @@ pub fn build(b: *std.Build) void {
     ccsg.addCSourceFiles(.{
         .files = &.{
             "bindings/c/ccsg.cpp",
+            "classify.cpp",
+            "clone.cpp",
             "csg.cpp",
+            "exact.cpp",
+            "map_import.cpp",
+            "mesh.cpp",
+            "mesh_pack.cpp",
+            "query_batch.cpp",
             "query_box.cpp",
             "query_frustum.cpp",
             "query_point.cpp",
             "query_ray.cpp",
+            "query_volume.cpp",
             "rebuild.cpp",
+            "snapshot.cpp",
+            "version.cpp",
         },
         .flags = &.{
             "-std=c++20",
@@ -75,6 +97,7 @@ pub fn build(b: *std.Build) void {
     }
 
     if (options.use_custom_alloc) tests.defineCMacro("CSG_CUSTOM_ALLOCATOR_HEADER", "\"bindings/c/ccsg_memory.hpp\"");
+    if (options.use_double_precision) tests.defineCMacro("CSG_SCALAR", "double");
     tests.addCSourceFile(.{
         .file = b.path("bindings/c/ccsg_tests.c"),
         .flags = &.{
@@ -0,0 +1,362 @@
+#include "csg_private.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CSG_X86
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define CSG_TARGET_AVX2
+#else
+#define CSG_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace csg {
+
+/*
+    the tolerance used here must match approx_equal() in rebuild.cpp: a
+    signed distance d counts as zero when round(d*1000) == 0, i.e. when
+    |d*1000| < 0.5. all kernels evaluate the distance in the same order as
+    glm::dot(normal, point) + offset so they agree bit for bit.
+*/
+
+static constexpr scalar_t distance_scale = 1000;
+static constexpr scalar_t aligned_limit  = 0.5;
+
+static relation_t classify_distance(scalar_t d) {
+    scalar_t scaled = d * distance_scale;
+    if (scaled < aligned_limit && scaled > -aligned_limit)
+        return RELATION_ALIGNED;
+    else if (scaled > 0)
+        return RELATION_FRONT;
+    else
+        return RELATION_BACK;
+}
+
+// scalar fallback
+// -------------------------------------------------------------------------
+static void classify_points_scalar(const plane_t& plane,
+                                   const scalar_t *x, const scalar_t *y, const scalar_t *z,
+                                   int count, relation_t *relations)
+{
+    for (int i=0; i<count; ++i) {
+        scalar_t d = plane.normal.x*x[i] + plane.normal.y*y[i] + plane.normal.z*z[i];
+        relations[i] = classify_distance(d + plane.offset);
+    }
+}
+
+#ifndef CSG_X86
+static relation_t classify_point_scalar(const vec3_t& point,
+                                        const scalar_t *plane_soa, int plane_count)
+{
+    int stride = plane_soa_stride(plane_count);
+    const scalar_t *nx = plane_soa;
+    const scalar_t *ny = nx + stride;
+    const scalar_t *nz = ny + stride;
+    const scalar_t *offset = nz + stride;
+
+    relation_t rel = RELATION_INSIDE;
+    for (int i=0; i<plane_count; ++i) {
+        scalar_t d = nx[i]*point.x + ny[i]*point.y + nz[i]*point.z;
+        switch (classify_distance(d + offset[i])) {
+            case RELATION_FRONT:
+                return RELATION_OUTSIDE;
+            case RELATION_ALIGNED:
+                rel = RELATION_ALIGNED;
+            default:
+                ;
+        }
+    }
+    return rel;
+}
+#endif
+
+#ifdef CSG_X86
+/*
+    the kernels below are written once against a small set of vector ops,
+    specialized for float and double. aligned()/front() return one bit per
+    lane like movemask, store() writes one relation per lane.
+*/
+
+// aligned -> 2, front -> 0, otherwise (back) -> 1
+static void store_relations(int aligned, int front, int width, relation_t *relations) {
+    for (int l=0; l<width; ++l) {
+        int a = (aligned >> l) & 1;
+        int f = (front >> l) & 1;
+        relations[l] = relation_t(a*RELATION_ALIGNED + (1-a)*(1-f)*RELATION_BACK);
+    }
+}
+
+// sse2 (always available on x86-64)
+// -------------------------------------------------------------------------
+template<typename scalar>
+struct sse2_ops;
+
+template<>
+struct sse2_ops<float> {
+    using reg_t = __m128;
+    static constexpr int width = 4;
+    static reg_t set1(float a)                 { return _mm_set1_ps(a); }
+    static reg_t load(const float *p)          { return _mm_loadu_ps(p); }
+    static reg_t add(reg_t a, reg_t b)         { return _mm_add_ps(a, b); }
+    static reg_t mul(reg_t a, reg_t b)         { return _mm_mul_ps(a, b); }
+    static reg_t abs(reg_t a)                  { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+    static int   less(reg_t a, reg_t b)        { return _mm_movemask_ps(_mm_cmplt_ps(a, b)); }
+    static int   greater_equal(reg_t a, reg_t b) { return _mm_movemask_ps(_mm_cmpge_ps(a, b)); }
+
+    // relations are 32 bit, so with float lanes they can be built in register
+    static void classify(reg_t scaled, relation_t *relations) {
+        __m128 limit   = _mm_set1_ps(aligned_limit);
+        __m128 aligned = _mm_cmplt_ps(abs(scaled), limit);
+        __m128 front   = _mm_cmpge_ps(scaled, limit);
+        __m128i result = _mm_and_si128(_mm_castps_si128(aligned), _mm_set1_epi32(RELATION_ALIGNED));
+        __m128i back   = _mm_andnot_si128(_mm_castps_si128(_mm_or_ps(aligned, front)),
+                                          _mm_set1_epi32(RELATION_BACK));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(relations), _mm_or_si128(result, back));
+    }
+};
+
+template<>
+struct sse2_ops<double> {
+    using reg_t = __m128d;
+    static constexpr int width = 2;
+    static reg_t set1(double a)                { return _mm_set1_pd(a); }
+    static reg_t load(const double *p)         { return _mm_loadu_pd(p); }
+    static reg_t add(reg_t a, reg_t b)         { return _mm_add_pd(a, b); }
+    static reg_t mul(reg_t a, reg_t b)         { return _mm_mul_pd(a, b); }
+    static reg_t abs(reg_t a)                  { return _mm_andnot_pd(_mm_set1_pd(-0.0), a); }
+    static int   less(reg_t a, reg_t b)        { return _mm_movemask_pd(_mm_cmplt_pd(a, b)); }
+    static int   greater_equal(reg_t a, reg_t b) { return _mm_movemask_pd(_mm_cmpge_pd(a, b)); }
+
+    static void classify(reg_t scaled, relation_t *relations) {
+        reg_t limit = set1(aligned_limit);
+        store_relations(less(abs(scaled), limit), greater_equal(scaled, limit), width, relations);
+    }
+};
+
+static void classify_points_sse2(const plane_t& plane,
+                                 const scalar_t *x, const scalar_t *y, const scalar_t *z,
+                                 int count, relation_t *relations)
+{
+    using ops = sse2_ops<scalar_t>;
+    ops::reg_t nx = ops::set1(plane.normal.x);
+    ops::reg_t ny = ops::set1(plane.normal.y);
+    ops::reg_t nz = ops::set1(plane.normal.z);
+    ops::reg_t offset = ops::set1(plane.offset);
+    ops::reg_t scale  = ops::set1(distance_scale);
+    int i = 0;
+    for (; i+ops::width<=count; i+=ops::width) {
+        ops::reg_t d = ops::add(ops::mul(nx, ops::load(x+i)), ops::mul(ny, ops::load(y+i)));
+        d = ops::add(ops::add(d, ops::mul(nz, ops::load(z+i))), offset);
+        ops::classify(ops::mul(d, scale), relations+i);
+    }
+    classify_points_scalar(plane, x+i, y+i, z+i, count-i, relations+i);
+}
+
+static relation_t classify_point_sse2(const vec3_t& point,
+                                      const scalar_t *plane_soa, int plane_count)
+{
+    using ops = sse2_ops<scalar_t>;
+    int stride = plane_soa_stride(plane_count);
+    ops::reg_t px = ops::set1(point.x);
+    ops::reg_t py = ops::set1(point.y);
+    ops::reg_t pz = ops::set1(point.z);
+    ops::reg_t scale = ops::set1(distance_scale);
+    ops::reg_t limit = ops::set1(aligned_limit);
+    int any_aligned = 0;
+    for (int i=0; i<plane_count; i+=ops::width) {
+        ops::reg_t nx = ops::load(plane_soa + i);
+        ops::reg_t ny = ops::load(plane_soa + i + stride);
+        ops::reg_t nz = ops::load(plane_soa + i + stride*2);
+        ops::reg_t offset = ops::load(plane_soa + i + stride*3);
+        ops::reg_t d = ops::add(ops::mul(nx, px), ops::mul(ny, py));
+        d = ops::add(ops::add(d, ops::mul(nz, pz)), offset);
+        ops::reg_t scaled = ops::mul(d, scale);
+        // lanes past plane_count are zero padding, mask them out
+        int valid = (plane_count-i >= ops::width)? (1 << ops::width) - 1: (1 << (plane_count-i)) - 1;
+        if (ops::greater_equal(scaled, limit) & valid)
+            return RELATION_OUTSIDE;
+        any_aligned |= ops::less(ops::abs(scaled), limit) & valid;
+    }
+    return any_aligned? RELATION_ALIGNED: RELATION_INSIDE;
+}
+
+// avx2
+// -------------------------------------------------------------------------
+template<typename scalar>
+struct avx2_ops;
+
+template<>
+struct avx2_ops<float> {
+    using reg_t = __m256;
+    static constexpr int width = 8;
+    CSG_TARGET_AVX2 static reg_t set1(float a)          { return _mm256_set1_ps(a); }
+    CSG_TARGET_AVX2 static reg_t load(const float *p)   { return _mm256_loadu_ps(p); }
+    CSG_TARGET_AVX2 static reg_t add(reg_t a, reg_t b)  { return _mm256_add_ps(a, b); }
+    CSG_TARGET_AVX2 static reg_t mul(reg_t a, reg_t b)  { return _mm256_mul_ps(a, b); }
+    CSG_TARGET_AVX2 static reg_t abs(reg_t a)           { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    CSG_TARGET_AVX2 static int less(reg_t a, reg_t b) {
+        return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LT_OQ));
+    }
+    CSG_TARGET_AVX2 static int greater_equal(reg_t a, reg_t b) {
+        return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_GE_OQ));
+    }
+
+    CSG_TARGET_AVX2 static void classify(reg_t scaled, relation_t *relations) {
+        __m256 limit   = _mm256_set1_ps(aligned_limit);
+        __m256 aligned = _mm256_cmp_ps(abs(scaled), limit, _CMP_LT_OQ);
+        __m256 front   = _mm256_cmp_ps(scaled, limit, _CMP_GE_OQ);
+        __m256i result = _mm256_and_si256(_mm256_castps_si256(aligned),
+                                          _mm256_set1_epi32(RELATION_ALIGNED));
+        __m256i back   = _mm256_andnot_si256(_mm256_castps_si256(_mm256_or_ps(aligned, front)),
+                                             _mm256_set1_epi32(RELATION_BACK));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(relations), _mm256_or_si256(result, back));
+    }
+};
+
+template<>
+struct avx2_ops<double> {
+    using reg_t = __m256d;
+    static constexpr int width = 4;
+    CSG_TARGET_AVX2 static reg_t set1(double a)         { return _mm256_set1_pd(a); }
+    CSG_TARGET_AVX2 static reg_t load(const double *p)  { return _mm256_loadu_pd(p); }
+    CSG_TARGET_AVX2 static reg_t add(reg_t a, reg_t b)  { return _mm256_add_pd(a, b); }
+    CSG_TARGET_AVX2 static reg_t mul(reg_t a, reg_t b)  { return _mm256_mul_pd(a, b); }
+    CSG_TARGET_AVX2 static reg_t abs(reg_t a)           { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+    CSG_TARGET_AVX2 static int less(reg_t a, reg_t b) {
+        return _mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_LT_OQ));
+    }
+    CSG_TARGET_AVX2 static int greater_equal(reg_t a, reg_t b) {
+        return _mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_GE_OQ));
+    }
+
+    CSG_TARGET_AVX2 static void classify(reg_t scaled, relation_t *relations) {
+        reg_t limit = set1(aligned_limit);
+        store_relations(less(abs(scaled), limit), greater_equal(scaled, limit), width, relations);
+    }
+};
+
+CSG_TARGET_AVX2
+static void classify_points_avx2(const plane_t& plane,
+                                 const scalar_t *x, const scalar_t *y, const scalar_t *z,
+                                 int count, relation_t *relations)
+{
+    using ops = avx2_ops<scalar_t>;
+    ops::reg_t nx = ops::set1(plane.normal.x);
+    ops::reg_t ny = ops::set1(plane.normal.y);
+    ops::reg_t nz = ops::set1(plane.normal.z);
+    ops::reg_t offset = ops::set1(plane.offset);
+    ops::reg_t scale  = ops::set1(distance_scale);
+    int i = 0;
+    for (; i+ops::width<=count; i+=ops::width) {
+        ops::reg_t d = ops::add(ops::mul(nx, ops::load(x+i)), ops::mul(ny, ops::load(y+i)));
+        d = ops::add(ops::add(d, ops::mul(nz, ops::load(z+i))), offset);
+        ops::classify(ops::mul(d, scale), relations+i);
+    }
+    classify_points_sse2(plane, x+i, y+i, z+i, count-i, relations+i);
+}
+
+CSG_TARGET_AVX2
+static relation_t classify_point_avx2(const vec3_t& point,
+                                      const scalar_t *plane_soa, int plane_count)
+{
+    using ops = avx2_ops<scalar_t>;
+    int stride = plane_soa_stride(plane_count);
+    ops::reg_t px = ops::set1(point.x);
+    ops::reg_t py = ops::set1(point.y);
+    ops::reg_t pz = ops::set1(point.z);
+    ops::reg_t scale = ops::set1(distance_scale);
+    ops::reg_t limit = ops::set1(aligned_limit);
+    int any_aligned = 0;
+    for (int i=0; i<plane_count; i+=ops::width) {
+        ops::reg_t nx = ops::load(plane_soa + i);
+        ops::reg_t ny = ops::load(plane_soa + i + stride);
+        ops::reg_t nz = ops::load(plane_soa + i + stride*2);
+        ops::reg_t offset = ops::load(plane_soa + i + stride*3);
+        ops::reg_t d = ops::add(ops::mul(nx, px), ops::mul(ny, py));
+        d = ops::add(ops::add(d, ops::mul(nz, pz)), offset);
+        ops::reg_t scaled = ops::mul(d, scale);
+        int valid = (plane_count-i >= ops::width)? (1 << ops::width) - 1: (1 << (plane_count-i)) - 1;
+        if (ops::greater_equal(scaled, limit) & valid)
+            return RELATION_OUTSIDE;
+        any_aligned |= ops::less(ops::abs(scaled), limit) & valid;
+    }
+    return any_aligned? RELATION_ALIGNED: RELATION_INSIDE;
+}
+
+static bool cpu_has_avx2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7)
+        return false;
+    __cpuid(regs, 1);
+    bool osxsave = (regs[2] >> 27) & 1;
+    bool avx     = (regs[2] >> 28) & 1;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+        return false;
+    __cpuidex(regs, 7, 0);
+    return (regs[1] >> 5) & 1;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif // CSG_X86
+
+// runtime dispatch
+// -------------------------------------------------------------------------
+using classify_points_fn = void(*)(const plane_t&,
+                                   const scalar_t*, const scalar_t*, const scalar_t*,
+                                   int, relation_t*);
+using classify_point_fn = relation_t(*)(const vec3_t&, const scalar_t*, int);
+
+struct classify_kernels_t {
+    classify_points_fn points;
+    classify_point_fn  point;
+};
+
+static classify_kernels_t select_kernels() {
+#ifdef CSG_X86
+    if (cpu_has_avx2())
+        return { classify_points_avx2, classify_point_avx2 };
+    return { classify_points_sse2, classify_point_sse2 };
+#else
+    return { classify_points_scalar, classify_point_scalar };
+#endif
+}
+
+static const classify_kernels_t& kernels() {
+    static const classify_kernels_t selected = select_kernels();
+    return selected;
+}
+
+int plane_soa_stride(int plane_count) {
+    return (plane_count + plane_soa_width - 1) / plane_soa_width * plane_soa_width;
+}
+
+void make_plane_soa(const vector_t<plane_t>& planes, vector_t<scalar_t>& soa) {
+    int n = planes.size();
+    int stride = plane_soa_stride(n);
+    soa.assign(stride * 4, scalar_t(0));
+    for (int i=0; i<n; ++i) {
+        soa[i]          = planes[i].normal.x;
+        soa[i+stride]   = planes[i].normal.y;
+        soa[i+stride*2] = planes[i].normal.z;
+        soa[i+stride*3] = planes[i].offset;
+    }
+}
+
+void classify_points(const plane_t& plane,
+                     const scalar_t *x, const scalar_t *y, const scalar_t *z,
+                     int count, relation_t *relations)
+{
+    kernels().points(plane, x, y, z, count, relations);
+}
+
+relation_t classify_point(const vec3_t& point,
+                          const scalar_t *plane_soa, int plane_count)
+{
+    return kernels().point(point, plane_soa, plane_count);
+}
+
+}
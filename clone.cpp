@@ -0,0 +1,163 @@
+#include "csg_private.hpp"
+#include <algorithm>
+
+namespace csg {
+
+/*
+    clone copies every brush and shape as a whole and then points the
+    copies at each other: brushes refer to brushes (list links,
+    intersecting_brushes, fragment brushes), vertices of faces, fragments
+    and carved pieces refer to faces of any brush (or of their shape), and
+    faces refer to their brush's planes. the old pointers are looked up in
+    sorted tables of what was copied where
+*/
+
+struct face_range_t {
+    const face_t    *begin;
+    const face_t    *end;
+    face_t          *to;
+};
+
+struct clone_map_t {
+    vector_t<std::pair<const brush_t*, brush_t*>> brushes;  // by old pointer
+    vector_t<face_range_t>                        faces;    // by begin
+    map_t<const shape_t*, shape_t*>               shapes;
+};
+
+static brush_t *map_brush(const clone_map_t& map, const brush_t *brush) {
+    auto it = std::lower_bound(map.brushes.begin(), map.brushes.end(), brush,
+        [](const std::pair<const brush_t*, brush_t*>& entry, const brush_t *brush) {
+            return entry.first < brush;
+        });
+    return (it != map.brushes.end() && it->first == brush)? it->second: nullptr;
+}
+
+static face_t *map_face(const clone_map_t& map, const face_t *face) {
+    auto it = std::upper_bound(map.faces.begin(), map.faces.end(), face,
+        [](const face_t *face, const face_range_t& range) {
+            return face < range.begin;
+        });
+    if (it == map.faces.begin())
+        return nullptr;
+    --it;
+    return (face < it->end)? it->to + (face - it->begin): nullptr;
+}
+
+static void add_faces(clone_map_t& map, const vector_t<face_t>& from, vector_t<face_t>& to) {
+    if (!from.empty())
+        map.faces.push_back(face_range_t{ from.data(), from.data() + from.size(), to.data() });
+}
+
+// the nodes of the copied face sets are reused, only their order can
+// change. faces of brushes that weren't copied (removed since the last
+// rebuild) are left out, only stale fragments and carves refer to them
+static void map_vertices(const clone_map_t& map, vector_t<vertex_t>& vertices) {
+    for (vertex_t& vertex: vertices) {
+        set_t<face_t*> faces;
+        while (!vertex.faces.empty()) {
+            auto node = vertex.faces.extract(vertex.faces.begin());
+            node.value() = map_face(map, node.value());
+            if (node.value())
+                faces.insert(std::move(node));
+        }
+        vertex.faces = std::move(faces);
+    }
+}
+
+static void map_face_planes(vector_t<face_t>& faces, const vector_t<plane_t>& from,
+                            const vector_t<plane_t>& to) {
+    // faces not rebuilt since their planes changed can point anywhere
+    for (face_t& face: faces) {
+        bool in_from = face.plane >= from.data() && face.plane < from.data() + from.size();
+        face.plane = in_from? &to[face.plane - from.data()]: nullptr;
+    }
+}
+
+static shape_t *copy_shape(clone_map_t& map, const shape_t *shape) {
+    if (!shape)
+        return nullptr;
+    shape_t*& copy = map.shapes[shape];
+    if (!copy) {
+        copy = new shape_t;
+        copy->planes = shape->planes;
+        copy->positions = shape->positions;
+        copy->faces = shape->faces;
+        copy->has_positions = shape->has_positions;
+        copy->shared = shape->shared;
+        copy->refs = 0;
+        add_faces(map, shape->faces, copy->faces);
+    }
+    copy->refs += 1;
+    return copy;
+}
+
+world_t world_t::clone() const {
+    world_t world;
+    world.void_volume = void_volume;
+    world.next_uid = next_uid;
+    world.track_fragment_changes = track_fragment_changes;
+    world.plane_table = plane_table;
+    world.plane_refs = plane_refs;
+    world.free_plane_ids = free_plane_ids;
+    world.plane_lookup = plane_lookup;
+    world.userdata = userdata;
+
+    clone_map_t map;
+    for (shape_t *shape: shapes)
+        world.shapes.push_back(copy_shape(map, shape));
+
+    for (const brush_t *brush = sentinel->next; brush != sentinel; brush = brush->next) {
+        brush_t *copy = new brush_t(*brush);
+        copy->world = &world;
+        copy->shape = copy_shape(map, brush->shape);
+        brush_t *last = world.sentinel->prev;
+        last->next = copy;
+        copy->prev = last;
+        copy->next = world.sentinel;
+        world.sentinel->prev = copy;
+        map.brushes.push_back({ brush, copy });
+        add_faces(map, brush->faces, copy->faces);
+    }
+    std::sort(map.brushes.begin(), map.brushes.end());
+    std::sort(map.faces.begin(), map.faces.end(),
+        [](const face_range_t& a, const face_range_t& b) { return a.begin < b.begin; });
+
+    for (const auto& shape: map.shapes) {
+        shape_t *copy = shape.second;
+        map_face_planes(copy->faces, shape.first->planes, copy->planes);
+        for (face_t& face: copy->faces)
+            map_vertices(map, face.vertices);
+    }
+
+    for (const auto& brush: map.brushes) {
+        brush_t *copy = brush.second;
+        for (brush_t*& intersecting: copy->intersecting_brushes)
+            intersecting = map_brush(map, intersecting);
+        map_face_planes(copy->faces, brush.first->planes, copy->planes);
+        for (face_t& face: copy->faces) {
+            map_vertices(map, face.vertices);
+            for (fragment_t& fragment: face.fragments) {
+                fragment.face = &face;
+                map_vertices(map, fragment.vertices);
+                fragment.front_brush = fragment.front_brush? map_brush(map, fragment.front_brush): nullptr;
+                fragment.back_brush = map_brush(map, fragment.back_brush);
+            }
+        }
+        for (face_carve_t& carve: copy->face_carves) {
+            for (carved_piece_t& piece: carve.pieces)
+                map_vertices(map, piece.vertices);
+        }
+    }
+
+    // same dirty brushes in the same order, and the edits of an open
+    // begin_edit are applied since the copy isn't in one
+    world.dirty_brushes.reserve(dirty_brushes.size());
+    for (const brush_t *brush: dirty_brushes)
+        world.dirty_brushes.push_back(map_brush(map, brush));
+    for (const brush_t *brush: edited_brushes)
+        world.edited_brushes.push_back(map_brush(map, brush));
+    apply_pending_edits(&world);
+    return world;
+}
+
+}
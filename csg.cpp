@@ -1,56 +1,292 @@
 #include "csg_private.hpp"
+#include <algorithm>
+#include <string.h>
 
 namespace csg {
 
-vector_t<triangle_t> triangulate(const fragment_t& fragment) {
+int triangle_count(const fragment_t& fragment) {
+    return std::max(int(fragment.vertices.size()) - 2, 0);
+}
+
+triangle_t *triangulate(const fragment_t& fragment, triangle_t *out) {
+    // each step cuts two triangles off the front of the polygon
+    // (first, second, third) and (third, third+1, third+2), which leaves
+    // first, third and the vertices after third+1. so the remaining polygon
+    // is always first, second and a run of consecutive vertices from third
     int vertex_count = fragment.vertices.size();
-    vector_t<int> indices;
-    vector_t<triangle_t> tris;
-    indices.resize(vertex_count);
-    for (int i=0; i<vertex_count; ++i)
-        indices[i] = i;
+    if (vertex_count < 3)
+        return out;
+    int first = 0, second = 1, third = 2;
     for (;;) {
-        int n = indices.size();
-        if (n < 3)
+        int n = 2 + vertex_count - third;
+        *out++ = triangle_t{first, second, third};
+        if (n == 3)
             break;
-        if (n == 3) {
-            tris.push_back(triangle_t{indices[0], indices[1], indices[2]});
+        *out++ = triangle_t{third, third + 1, n > 4? third + 2: first};
+        if (n == 4)
             break;
-        }
-        tris.push_back(triangle_t{indices[0], indices[1], indices[2]});
-        tris.push_back(triangle_t{indices[2], indices[3], indices[4 % n]});
-        indices.erase(indices.begin() + 3);
-        indices.erase(indices.begin() + 1);
+        second = third;
+        third += 2;
     }
-    return tris;    
+    return out;
+}
+
+vector_t<triangle_t> triangulate(const fragment_t& fragment) {
+    vector_t<triangle_t> tris(triangle_count(fragment));
+    triangulate(fragment, tris.data());
+    return tris;
+}
+
+// the triangle counts of all fragments are summed up first, so every
+// fragment can then write its triangles straight to its offset
+static void add_offsets(const brush_t *brush, triangulation_t& triangulation) {
+    for (const face_t& face: brush->faces)
+        for (const fragment_t& fragment: face.fragments)
+            triangulation.offsets.push_back(triangulation.offsets.back() + triangle_count(fragment));
+}
+
+static void add_triangles(const brush_t *brush, triangulation_t& triangulation, size_t& fragment_index) {
+    for (const face_t& face: brush->faces)
+        for (const fragment_t& fragment: face.fragments)
+            triangulate(fragment, triangulation.triangles.data() + triangulation.offsets[fragment_index++]);
+}
+
+void triangulate(const brush_t *brush, triangulation_t& triangulation) {
+    triangulation.offsets.assign(1, 0);
+    add_offsets(brush, triangulation);
+    triangulation.triangles.resize(triangulation.offsets.back());
+    size_t fragment_index = 0;
+    add_triangles(brush, triangulation, fragment_index);
+}
+
+void triangulate(world_t *world, triangulation_t& triangulation) {
+    triangulation.offsets.assign(1, 0);
+    for (brush_t *brush = world->first(); brush; brush = world->next(brush))
+        add_offsets(brush, triangulation);
+    triangulation.triangles.resize(triangulation.offsets.back());
+    size_t fragment_index = 0;
+    for (brush_t *brush = world->first(); brush; brush = world->next(brush))
+        add_triangles(brush, triangulation, fragment_index);
 }
 
 volume_operation_t make_fill_operation(volume_t with) {
-    return [=](volume_t) { return with; };
+    return fill_operation_t{ with };
 }
 
 volume_operation_t make_convert_operation(volume_t from, volume_t to) {
-    return [=](volume_t old) {
-        return (old == from)? to: old;
-    };
+    return convert_operation_t{ from, to };
+}
+
+static plane_t canonical_plane(const plane_t& plane) {
+    // flip so the first non-zero component of the normal is positive, the
+    // two orientations of a plane then map to the same table entry
+    for (int i=0; i<3; ++i) {
+        if (plane.normal[i] > 0)
+            return plane;
+        if (plane.normal[i] < 0)
+            return plane_t{ -plane.normal, -plane.offset };
+    }
+    return plane;
+}
+
+static std::array<scalar_t, 4> plane_key(const plane_t& canonical) {
+    return { canonical.normal.x, canonical.normal.y, canonical.normal.z, canonical.offset };
+}
+
+static uint64_t hash_plane_key(const std::array<scalar_t, 4>& key) {
+    uint64_t hash = 0;
+    for (scalar_t component: key) {
+        uint64_t bits = 0;
+        memcpy(&bits, &component, sizeof(component));
+        hash = (hash ^ bits) * 0x9e3779b97f4a7c15ull;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+// adds refs references to the table entry of a canonical plane, it is
+// plane_lookup.lower_bound of the plane's key
+static int intern_plane_at(world_t *world, map_t<std::array<scalar_t, 4>, int>::iterator it,
+                           const plane_t& canonical, int refs) {
+    std::array<scalar_t, 4> key = plane_key(canonical);
+    if (it != world->plane_lookup.end() && it->first == key) {
+        world->plane_refs[it->second] += refs;
+        return it->second;
+    }
+    int plane_id;
+    if (!world->free_plane_ids.empty()) {
+        plane_id = world->free_plane_ids.back();
+        world->free_plane_ids.pop_back();
+        world->plane_table[plane_id] = canonical;
+        world->plane_refs[plane_id] = refs;
+    } else {
+        plane_id = world->plane_table.size();
+        world->plane_table.push_back(canonical);
+        world->plane_refs.push_back(refs);
+    }
+    world->plane_lookup.emplace_hint(it, key, plane_id);
+    return plane_id;
+}
+
+static int intern_plane(world_t *world, const plane_t& plane) {
+    plane_t canonical = canonical_plane(plane);
+    return intern_plane_at(world, world->plane_lookup.lower_bound(plane_key(canonical)), canonical, 1);
+}
+
+static void release_plane(world_t *world, int plane_id) {
+    if (--world->plane_refs[plane_id] > 0)
+        return;
+    const plane_t& plane = world->plane_table[plane_id];
+    world->plane_lookup.erase({ plane.normal.x, plane.normal.y, plane.normal.z, plane.offset });
+    world->free_plane_ids.push_back(plane_id);
+}
+
+static void release_planes(brush_t *brush) {
+    for (int plane_id: brush->plane_ids)
+        release_plane(brush->world, plane_id);
+    brush->plane_ids.clear();
+}
+
+static void release_shape(shape_t *shape) {
+    if (shape && --shape->refs == 0)
+        delete shape;
+}
+
+void mark_needs(brush_t *brush, int needs) {
+    if (brush->needs == 0) {
+        brush->dirty_index = brush->world->dirty_brushes.size();
+        brush->world->dirty_brushes.push_back(brush);
+    }
+    brush->needs |= needs;
+}
+
+void mark_faces_dirty(brush_t *brush, const box_t& region) {
+    brush->dirty_boxes.push_back(region);
+    mark_needs(brush, NEED_FRAGMENT_REBUILD);
+}
+
+void mark_all_faces_dirty(brush_t *brush) {
+    brush->all_faces_dirty = true;
+    mark_needs(brush, NEED_FRAGMENT_REBUILD);
+}
+
+static void apply_edits(brush_t *brush, int edits) {
+    if (edits & EDIT_PLANES)
+        mark_needs(brush, NEED_FACE_AND_BOX_REBUILD);
+    else if (edits & EDIT_TRANSFORM)
+        mark_needs(brush, NEED_FACE_TRANSFORM);
+    if (edits & EDIT_VOLUMES)
+        mark_all_faces_dirty(brush);
+    // the faces of brushes around a new box get marked once it's known
+    for (brush_t* intersecting: brush->intersecting_brushes)
+        mark_faces_dirty(intersecting, brush->box);
+}
+
+static void edit(brush_t *brush, int edits) {
+    world_t *world = brush->world;
+    if (world->edit_depth == 0) {
+        apply_edits(brush, edits);
+        return;
+    }
+    // between begin_edit and end_edit only remember what changed, the
+    // brush's box stays what it was at the last rebuild until then
+    if (brush->pending_edits == 0)
+        world->edited_brushes.push_back(brush);
+    brush->pending_edits |= edits;
+}
+
+void apply_pending_edits(world_t *world) {
+    for (brush_t *brush: world->edited_brushes) {
+        apply_edits(brush, brush->pending_edits);
+        brush->pending_edits = 0;
+    }
+    world->edited_brushes.clear();
+}
+
+static void update_plane_ids(brush_t *brush) {
+#ifdef CSG_EXACT_PLANES
+    for (plane_t& plane: brush->planes)
+        plane = snap_plane(plane);
+#endif
+    release_planes(brush);
+    for (const plane_t& plane: brush->planes)
+        brush->plane_ids.push_back(intern_plane(brush->world, plane));
+    brush->planes_version += 1;
 }
 
 void brush_t::set_planes(const vector_t<plane_t>& planes) {
+    if (!shape || shape->shared) {
+        release_shape(shape);
+        shape = new shape_t;
+        shape->shared = false;
+        shape->refs = 1;
+    }
+    shape->planes = planes;
+    shape->has_positions = false;
     this->planes = planes;
-    world->need_face_and_box_rebuild.insert(this);
-    for (brush_t* intersecting: intersecting_brushes)
-        world->need_fragment_rebuild.insert(intersecting);
+    transform = mat4_t(1);
+    faces_match_shape = false;
+    update_plane_ids(this);
+    edit(this, EDIT_PLANES);
 }
 
 const vector_t<plane_t>& brush_t::get_planes() const {
     return planes;
 }
 
+void brush_t::set_shape(shape_t *shape) {
+    shape->refs += 1;
+    release_shape(this->shape);
+    this->shape = shape;
+    planes.resize(shape->planes.size());
+    faces_match_shape = false;
+    set_transform(transform);
+}
+
+shape_t *brush_t::get_shape() const {
+    return (shape && shape->shared)? shape: nullptr;
+}
+
+void brush_t::set_transform(const mat4_t& transform) {
+    this->transform = transform;
+    if (!shape)
+        return;
+    // planes transform by the inverse transpose, computed in double so
+    // repeated transforms of the same base planes don't drift
+    glm::dmat4 plane_matrix = glm::transpose(glm::inverse(glm::dmat4(transform)));
+    for (size_t i=0; i<shape->planes.size(); ++i) {
+        const plane_t& base = shape->planes[i];
+        glm::dvec4 p = plane_matrix * glm::dvec4(glm::dvec3(base.normal), double(base.offset));
+        double length = glm::length(glm::dvec3(p));
+        planes[i] = plane_t{ vec3_t(glm::dvec3(p) / length), scalar_t(p.w / length) };
+    }
+    update_plane_ids(this);
+    // a transform that keeps the orientation keeps the topology too, so the
+    // faces only have to be moved (or copied from a shared shape). whether
+    // the shape has faces to move by then is up to rebuild, the first brush
+    // of a new shape builds them. exact planes are snapped after the
+    // transform, their vertices have to be intersected again
+#ifdef CSG_EXACT_PLANES
+    bool keeps_faces = false;
+#else
+    bool keeps_faces = glm::determinant(glm::dmat3(glm::dmat4(transform))) > 0;
+#endif
+    edit(this, keeps_faces? EDIT_TRANSFORM: EDIT_PLANES);
+}
+
+const mat4_t& brush_t::get_transform() const {
+    return transform;
+}
+
+void brush_t::translate(const vec3_t& offset) {
+    mat4_t moved = transform;
+    moved[3] += vec4_t(offset, 0);
+    set_transform(moved);
+}
+
 void brush_t::set_volume_operation(const volume_operation_t& volume_operation) {
     this->volume_operation = volume_operation;
-    world->need_fragment_rebuild.insert(this);
-    for (brush_t* intersecting: intersecting_brushes)
-        world->need_fragment_rebuild.insert(intersecting);
+    edit(this, EDIT_VOLUMES);
 }
 
 const vector_t<face_t>& brush_t::get_faces() const {
@@ -59,9 +295,7 @@ const vector_t<face_t>& brush_t::get_faces() const {
 
 void brush_t::set_time(int time) {
     this->time = time;
-    world->need_fragment_rebuild.insert(this);
-    for (brush_t* intersecting: intersecting_brushes)
-        world->need_fragment_rebuild.insert(intersecting);    
+    edit(this, EDIT_VOLUMES);
 }
 
 int brush_t::get_time() const {
@@ -83,18 +317,69 @@ world_t::world_t() {
     
     void_volume = 0;
     next_uid = 0;
+    edit_depth = 0;
+    track_fragment_changes = false;
 }
 
 world_t::~world_t() {
     brush_t *b = first();
     while (b) {
         brush_t *n = next(b);
+        release_shape(b->shape);
         delete b;
         b = n;
     }
+    for (brush_t *brush: removed_brushes)
+        delete brush;
+    for (const change_t& change: changes) {
+        if (change.kinds & CHANGE_REMOVED)
+            delete change.brush;
+    }
+    for (shape_t *shape: shapes)
+        release_shape(shape);
     delete sentinel;
 }
 
+// swaps everything two worlds own, their brushes are told which world they
+// are in now
+static void swap_worlds(world_t& a, world_t& b) {
+    std::swap(a.sentinel, b.sentinel);
+    std::swap(a.dirty_brushes, b.dirty_brushes);
+    std::swap(a.changes, b.changes);
+    std::swap(a.track_fragment_changes, b.track_fragment_changes);
+    std::swap(a.fragment_changes, b.fragment_changes);
+    std::swap(a.removed_brushes, b.removed_brushes);
+    std::swap(a.void_volume, b.void_volume);
+    std::swap(a.next_uid, b.next_uid);
+    std::swap(a.plane_table, b.plane_table);
+    std::swap(a.plane_refs, b.plane_refs);
+    std::swap(a.free_plane_ids, b.free_plane_ids);
+    std::swap(a.plane_lookup, b.plane_lookup);
+    std::swap(a.shapes, b.shapes);
+    std::swap(a.edit_depth, b.edit_depth);
+    std::swap(a.edited_brushes, b.edited_brushes);
+    std::swap(a.userdata, b.userdata);
+    for (world_t *world: { &a, &b }) {
+        for (brush_t *brush = world->sentinel->next; brush != world->sentinel; brush = brush->next)
+            brush->world = world;
+        for (brush_t *brush: world->removed_brushes)
+            brush->world = world;
+        for (const change_t& change: world->changes)
+            change.brush->world = world;
+    }
+}
+
+world_t::world_t(world_t&& other): world_t() {
+    swap_worlds(*this, other);
+}
+
+world_t& world_t::operator=(world_t&& other) {
+    // what this world had goes away with moved
+    world_t moved(std::move(other));
+    swap_worlds(*this, moved);
+    return *this;
+}
+
 brush_t *world_t::first() {
     return (sentinel->next == sentinel)? nullptr: sentinel->next;
 }
@@ -104,20 +389,48 @@ brush_t *world_t::next(brush_t *brush) {
 }
 
 void world_t::remove(brush_t *brush) {
+    if (brush->pending_edits != 0) {
+        auto it = std::find(edited_brushes.begin(), edited_brushes.end(), brush);
+        edited_brushes.erase(it);
+    }
+    release_planes(brush);
+    release_shape(brush->shape);
+    // whatever the brush did to its neighbours has to be undone, and they
+    // must not keep pointers to it
+    for (brush_t* intersecting: brush->intersecting_brushes) {
+        auto& others = intersecting->intersecting_brushes;
+        others.erase(std::remove(others.begin(), others.end(), brush), others.end());
+        mark_faces_dirty(intersecting, brush->box);
+    }
+    if (brush->needs != 0) {
+        brush_t *last = dirty_brushes.back();
+        dirty_brushes[brush->dirty_index] = last;
+        last->dirty_index = brush->dirty_index;
+        dirty_brushes.pop_back();
+    }
     brush_t *prev = brush->prev;
     brush_t *next = brush->next;
     prev->next = next;
     next->prev = prev;
-    delete brush;
+    // kept around so the next rebuild can report it
+    removed_brushes.push_back(brush);
 }
 
 brush_t *world_t::add() {
     brush_t *brush = new brush_t;
     brush->world = this;
     brush->volume_operation = std::identity{};
-    brush->box = box_t{ glm::vec3(1,1,1), glm::vec3(-1,-1,-1) };
+    brush->box = box_t{ vec3_t(1,1,1), vec3_t(-1,-1,-1) };
     brush->uid = next_uid++;
     brush->time = 0;//brush->uid;
+    brush->all_faces_dirty = true;
+    brush->planes_version = 0;
+    brush->shape = nullptr;
+    brush->transform = mat4_t(1);
+    brush->faces_match_shape = false;
+    brush->pending_edits = 0;
+    brush->needs = 0;
+    brush->change_kinds = 0;
 
     brush_t *after = sentinel->prev;
     brush_t *next = after->next;
@@ -129,11 +442,123 @@ brush_t *world_t::add() {
     return brush;
 }
 
+void world_t::add_many(int count, const plane_t *planes, const int *plane_counts,
+                       const volume_operation_t *operations, const int *times,
+                       brush_t **out_brushes) {
+    size_t total_planes = 0;
+    for (int i=0; i<count; ++i)
+        total_planes += plane_counts[i];
+
+    // intern the planes of all brushes together: equal planes are found
+    // with a hash table over the batch first, so every distinct plane is
+    // looked up in plane_lookup once with all its references
+    vector_t<plane_t> canonical(total_planes);
+    for (size_t i=0; i<total_planes; ++i) {
+#ifdef CSG_EXACT_PLANES
+        canonical[i] = canonical_plane(snap_plane(planes[i]));
+#else
+        canonical[i] = canonical_plane(planes[i]);
+#endif
+    }
+    size_t slot_count = 1;
+    while (slot_count < 2 * total_planes)
+        slot_count *= 2;
+    vector_t<size_t> slots(slot_count, size_t(-1));
+    vector_t<size_t> firsts(total_planes);   // first plane with the same key
+    vector_t<int> refs(total_planes, 0);
+    for (size_t i=0; i<total_planes; ++i) {
+        std::array<scalar_t, 4> key = plane_key(canonical[i]);
+        size_t slot = hash_plane_key(key) & (slot_count - 1);
+        while (slots[slot] != size_t(-1) && plane_key(canonical[slots[slot]]) != key)
+            slot = (slot + 1) & (slot_count - 1);
+        if (slots[slot] == size_t(-1))
+            slots[slot] = i;
+        firsts[i] = slots[slot];
+        refs[firsts[i]] += 1;
+    }
+    vector_t<int> plane_ids(total_planes);
+    for (size_t i=0; i<total_planes; ++i) {
+        if (refs[i] > 0) {
+            auto it = plane_lookup.lower_bound(plane_key(canonical[i]));
+            plane_ids[i] = intern_plane_at(this, it, canonical[i], refs[i]);
+        } else {
+            plane_ids[i] = plane_ids[firsts[i]];
+        }
+    }
+
+    // new brushes have no neighbours to mark yet, so they can skip the
+    // edit bookkeeping and go straight to the dirty list, also between
+    // begin_edit and end_edit
+    dirty_brushes.reserve(dirty_brushes.size() + count);
+    const plane_t *brush_planes = planes;
+    const int *brush_plane_ids = plane_ids.data();
+    for (int i=0; i<count; ++i) {
+        brush_t *brush = add();
+        int plane_count = plane_counts[i];
+        shape_t *shape = new shape_t;
+        shape->planes.assign(brush_planes, brush_planes + plane_count);
+        shape->has_positions = false;
+        shape->shared = false;
+        shape->refs = 1;
+        brush->shape = shape;
+        brush->planes = shape->planes;
+#ifdef CSG_EXACT_PLANES
+        for (plane_t& plane: brush->planes)
+            plane = snap_plane(plane);
+#endif
+        brush->plane_ids.assign(brush_plane_ids, brush_plane_ids + plane_count);
+        brush->planes_version = 1;
+        if (operations)
+            brush->volume_operation = operations[i];
+        if (times)
+            brush->time = times[i];
+        mark_needs(brush, NEED_FACE_AND_BOX_REBUILD);
+        if (out_brushes)
+            out_brushes[i] = brush;
+        brush_planes += plane_count;
+        brush_plane_ids += plane_count;
+    }
+}
+
+shape_t *world_t::add_shape(const vector_t<plane_t>& planes) {
+    shape_t *shape = new shape_t;
+    shape->planes = planes;
+    shape->has_positions = false;
+    shape->shared = true;
+    shape->refs = 1;
+    shapes.push_back(shape);
+    return shape;
+}
+
+void world_t::remove_shape(shape_t *shape) {
+    // brushes still placed with the shape keep it alive
+    shapes.erase(std::remove(shapes.begin(), shapes.end(), shape), shapes.end());
+    release_shape(shape);
+}
+
+void world_t::begin_edit() {
+    edit_depth += 1;
+}
+
+void world_t::end_edit() {
+    if (--edit_depth == 0)
+        apply_pending_edits(this);
+}
+
+void world_t::set_track_fragment_changes(bool enabled) {
+    track_fragment_changes = enabled;
+    fragment_changes.clear();
+}
+
+const vector_t<fragment_change_t>& world_t::get_fragment_changes() const {
+    return fragment_changes;
+}
+
 void world_t::set_void_volume(volume_t void_volume) {
     this->void_volume = void_volume;
     brush_t *b = first();
     while (b) {
-        need_fragment_rebuild.insert(b);
+        mark_all_faces_dirty(b);
         b = next(b);
     }    
 }
@@ -142,4 +567,12 @@ volume_t world_t::get_void_volume() const {
     return void_volume;
 }
 
+const plane_t& world_t::get_plane(int plane_id) const {
+    return plane_table[plane_id];
+}
+
+const vector_t<plane_t>& shape_t::get_planes() const {
+    return planes;
+}
+
 }
\ No newline at end of file
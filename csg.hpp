@@ -9,6 +9,11 @@
 #include <map>
 #include <functional>
 #include <any>
+#include <array>
+#include <string>
+#include <chrono>
+#include <memory>
+#include <cstdint>
 #include <glm/glm.hpp>
 
 #ifdef CSG_CUSTOM_ALLOCATOR_HEADER
@@ -20,6 +25,26 @@
 #define csg_map(K, T) std::map<K, T>
 #endif
 
+// CSG_SCALAR is the scalar type used for all geometry (float unless defined
+// otherwise, define it as double for a double precision build).
+// CSG_INTERSECTION_SCALAR is used when intersecting planes and defaults to
+// CSG_SCALAR, define only it as double for double precision vertices that
+// are output as float. define these the same way everywhere csg.hpp is
+// included.
+#ifndef CSG_SCALAR
+#define CSG_SCALAR float
+#endif
+
+#ifndef CSG_INTERSECTION_SCALAR
+#define CSG_INTERSECTION_SCALAR CSG_SCALAR
+#endif
+
+// define CSG_EXACT_PLANES when building the library to snap plane
+// coefficients to a grid (see snap_plane in csg_private.hpp) and decide
+// every vertex/plane relation with exact integer arithmetic instead of a
+// tolerance. results are then identical on every platform. only the
+// library needs it, requires __int128 (gcc/clang).
+
 namespace csg {
 
 template<class T>
@@ -35,21 +60,31 @@ using map_t = csg_map(T, K);
 #undef csg_set
 #undef csg_vector
 
+using scalar_t = CSG_SCALAR;
+using vec3_t   = glm::vec<3, scalar_t>;
+using vec4_t   = glm::vec<4, scalar_t>;
+using mat4_t   = glm::mat<4, 4, scalar_t>;
+
+using intersection_scalar_t = CSG_INTERSECTION_SCALAR;
+using intersection_vec3_t   = glm::vec<3, intersection_scalar_t>;
+
 struct world_t;
 struct face_t;
 struct brush_t;
 struct fragment_t;
+struct shape_t;
+struct world_version_t;
 
 struct plane_t {
     csg_replace_new_delete
-    glm::vec3 normal;
-    float     offset;
+    vec3_t    normal;
+    scalar_t  offset;
 };
 
 struct ray_t {
     csg_replace_new_delete
-    glm::vec3 origin;
-    glm::vec3 direction;
+    vec3_t    origin;
+    vec3_t    direction;
 };
 
 struct ray_hit_t {
@@ -57,13 +92,13 @@ struct ray_hit_t {
     brush_t    *brush;
     face_t     *face;
     fragment_t *fragment;
-    float      parameter;
-    glm::vec3  position;
+    scalar_t   parameter;
+    vec3_t     position;
 };
 
 struct box_t {
     csg_replace_new_delete
-    glm::vec3 min, max;
+    vec3_t    min, max;
 };
 
 using volume_t = int;
@@ -74,7 +109,7 @@ volume_operation_t make_convert_operation(volume_t from, volume_t to);
 
 struct vertex_t {
     csg_replace_new_delete
-    glm::vec3 position;
+    vec3_t         position;
     set_t<face_t*> faces;
 };
 
@@ -91,24 +126,142 @@ struct fragment_t {
     volume_t                back_volume;
     brush_t                 *front_brush;
     brush_t                 *back_brush;
+    // same id means same polygon with the same volumes and brushes on
+    // either side, see world_t::set_track_fragment_changes
+    uint64_t                id;
 
 module_private:
     int                     relation; 
 };
 
+// a convex fragment has max(vertex count - 2, 0) triangles. the pointer
+// version writes them to out without allocating and returns the end
+int                  triangle_count(const fragment_t& fragment);
+triangle_t           *triangulate(const fragment_t& fragment, triangle_t *out);
 vector_t<triangle_t> triangulate(const fragment_t& fragment);
 
+// triangles of every fragment of every face of a brush or world, in order.
+// fragment i has the triangles from offsets[i] up to offsets[i+1]. reused
+// triangulations don't allocate once they are large enough
+struct triangulation_t {
+    csg_replace_new_delete
+    vector_t<triangle_t>    triangles;
+    vector_t<uint32_t>      offsets;
+};
+
+void triangulate(const brush_t *brush, triangulation_t& triangulation);
+void triangulate(world_t *world, triangulation_t& triangulation);
+
 struct face_t {
     csg_replace_new_delete
     const plane_t           *plane;
     vector_t<vertex_t>      vertices;
     vector_t<fragment_t>    fragments;
+    int                     plane_id;   // see world_t::get_plane
+    int                     plane_sign; // +1 if plane faces the same way as get_plane(plane_id), else -1
+};
+
+// what a rebuild changed about a brush, flags in change_t::kinds
+enum change_kind_t {
+    CHANGE_FACES     = 1, // faces were built again or moved
+    CHANGE_FRAGMENTS = 2, // at least one face got new fragments
+    CHANGE_BOX       = 4, // box differs from the one before the rebuild
+    CHANGE_REMOVED   = 8, // brush was removed since the last rebuild
+    CHANGE_MOVED     = 16 // with CHANGE_FACES: faces were moved, not built again
+};
+
+struct change_t {
+    csg_replace_new_delete
+    brush_t                 *brush;
+    int                     kinds;
+};
+
+// a fragment of a rebuilt face compared to the fragments the face had
+// before, see world_t::set_track_fragment_changes
+enum fragment_change_kind_t {
+    FRAGMENT_KEPT,    // a fragment with the same id existed before
+    FRAGMENT_ADDED,
+    FRAGMENT_REMOVED  // fragment_index is -1
+};
+
+struct fragment_change_t {
+    csg_replace_new_delete
+    brush_t                 *brush;
+    int                     face_index;
+    int                     fragment_index;  // in face.fragments after the rebuild
+    int                     kind;
+    uint64_t                id;
+};
+
+// a face split up by the brushes around it, with each piece's relation to
+// each of them, cached until the planes of one of them change (see
+// rebuild_fragments in rebuild.cpp)
+struct carved_piece_t {
+    csg_replace_new_delete
+    vector_t<vertex_t>            vertices;
+    vector_t<int>                 relations; // one per carving brush
+    uint64_t                      id;        // hash of the face and the splits that made it
+};
+
+struct face_carve_t {
+    csg_replace_new_delete
+    vector_t<std::pair<int, int>> carvers;   // (uid, planes_version), by uid
+    vector_t<carved_piece_t>      pieces;
+};
+
+// planes of a convex polyhedron that any number of brushes can be placed
+// with (see world_t::add_shape and brush_t::set_shape). its faces are built
+// for the first of these brushes only and copied for the rest
+struct shape_t {
+    csg_replace_new_delete
+    const vector_t<plane_t>&    get_planes() const;
+
+module_private:
+    shape_t() = default;
+    ~shape_t() = default;
+    shape_t(const shape_t& other) = delete;
+    shape_t& operator=(const shape_t& other) = delete;
+    vector_t<plane_t>     planes;
+    // face vertex positions in face order, with the transform of the brush
+    // that built them undone, and for shared shapes the faces themselves
+    vector_t<vec3_t>      positions;
+    vector_t<face_t>      faces;
+    bool                  has_positions;
+    bool                  shared;
+    int                   refs;
+};
+
+// one brush as of a rebuild, never changed once made (see world_version_t).
+// the faces are copies that don't point into the world: face.plane points
+// at planes, vertex face sets are empty and fragment brush pointers are
+// null, fragment volumes and ids are kept
+struct brush_version_t {
+    csg_replace_new_delete
+    vector_t<plane_t>       planes;
+    vector_t<face_t>        faces;
+    box_t                   box;
+    int                     time;
+    int                     uid;
+};
+
+struct version_ray_hit_t {
+    csg_replace_new_delete
+    const brush_version_t   *brush;
+    const face_t            *face;
+    const fragment_t        *fragment;
+    scalar_t                parameter;
+    vec3_t                  position;
 };
 
 struct brush_t {
     csg_replace_new_delete
     void                        set_planes(const vector_t<plane_t>& planes);
     const vector_t<plane_t>&    get_planes() const;
+    void                        set_shape(shape_t *shape);
+    shape_t                     *get_shape() const;
+    void                        set_transform(const mat4_t& transform);
+    const mat4_t&               get_transform() const;
+    void                        translate(const vec3_t& offset);
     void                        set_volume_operation(const volume_operation_t& volume_operation);
     const vector_t<face_t>&     get_faces() const;
     void                        set_time(int time);
@@ -128,43 +281,550 @@ module_private:
     brush_t               *prev;
     world_t               *world;
     vector_t<plane_t>     planes;
+    vector_t<int>         plane_ids;
+    // planes is the planes of shape moved by transform. set_planes gives
+    // the brush a shape of its own
+    shape_t               *shape;
+    mat4_t                transform;
+    // whether faces line up with shape->positions, otherwise they have to
+    // be copied from shape->faces before they can be moved
+    bool                  faces_match_shape;
+    int                   pending_edits; // see edit_t in csg_private.hpp
+    int                   needs;         // see need_t in csg_private.hpp
+    int                   dirty_index;   // in world_t::dirty_brushes if needs != 0
+    int                   change_kinds;  // collected for world_t::changes during rebuild
+    vector_t<scalar_t>    plane_soa;
+    vector_t<intersection_vec3_t> plane_crosses;
     vector_t<brush_t*>    intersecting_brushes;
+    // regions where something changed since the last rebuild, only faces
+    // overlapping one of them get their fragments rebuilt
+    vector_t<box_t>       dirty_boxes;
+    bool                  all_faces_dirty;
     volume_operation_t    volume_operation;
     vector_t<face_t>      faces;
+    vector_t<face_carve_t> face_carves;
+    int                   planes_version;
     box_t                 box;
     int                   time;
     int                   uid;
+    // made by world_t::get_version, dropped when a rebuild touches the brush
+    std::shared_ptr<const brush_version_t> version;
 };
 
 struct world_t {
     csg_replace_new_delete
     world_t();
     ~world_t();
+    // moving hands over the brushes and shapes, their pointers stay valid.
+    // the moved from world is left empty. whatever keeps a pointer to the
+    // world (mesh_t, map_importer_t) has to be given the new one
+    world_t(world_t&& other);
+    world_t& operator=(world_t&& other);
+    // copies the brushes (in the same order, with the same uids) and
+    // shapes together with everything rebuild computed for them, so the
+    // copy only has to rebuild what the original would. userdata is copied
+    // as is, brushes removed since the last rebuild are left out
+    world_t                clone() const;
     brush_t                *first();
     brush_t                *next(brush_t *brush);
     void                   remove(brush_t *brush);
     brush_t                *add();
-    set_t<brush_t*>        rebuild();
+    // adds count brushes at once, as add followed by set_planes,
+    // set_volume_operation and set_time on each would. brush i takes the
+    // next plane_counts[i] planes, operations and times may be null to keep
+    // the defaults of add. the new brushes go to out_brushes unless null
+    void                   add_many(int count, const plane_t *planes, const int *plane_counts,
+                                    const volume_operation_t *operations, const int *times,
+                                    brush_t **out_brushes);
+    shape_t                *add_shape(const vector_t<plane_t>& planes);
+    void                   remove_shape(shape_t *shape);
+    // setters called between begin_edit and end_edit only record what
+    // changed, neighbours are marked once per brush at end_edit. pairs nest
+    void                   begin_edit();
+    void                   end_edit();
+    // the returned list is reused and stays valid until the next rebuild.
+    // removed brushes are reported once and deleted by the next rebuild,
+    // until then only their uid and userdata may be used
+    const vector_t<change_t>& rebuild();
+    // when enabled, rebuild also lists every fragment of every face it
+    // carved again as kept, added or removed (by fragment id). the list
+    // stays valid until the next rebuild, removed brushes aren't in it
+    void                   set_track_fragment_changes(bool enabled);
+    const vector_t<fragment_change_t>& get_fragment_changes() const;
     void                   set_void_volume(volume_t void_volume);
     volume_t               get_void_volume() const;
+    const plane_t&         get_plane(int plane_id) const;
+    // queries only read the world, any number of threads can run them at
+    // once as long as no thread edits or rebuilds it meanwhile (use
+    // get_version for that). the overloads taking a result vector clear
+    // and fill it, a vector kept per thread doesn't allocate once it is
+    // large enough. anything added to speed queries up must keep them
+    // free of writes to the world
     // todo: accelerate queries with bvh
-    vector_t<brush_t*>     query_point(const glm::vec3& point);
-    vector_t<brush_t*>     query_box(const box_t& box);
-    vector_t<ray_hit_t>    query_ray(const ray_t& ray);
-    vector_t<brush_t*>     query_frustum(const glm::mat4& view_projection);
+    vector_t<brush_t*>     query_point(const vec3_t& point) const;
+    void                   query_point(const vec3_t& point, vector_t<brush_t*>& result) const;
+    vector_t<brush_t*>     query_box(const box_t& box) const;
+    void                   query_box(const box_t& box, vector_t<brush_t*>& result) const;
+    vector_t<ray_hit_t>    query_ray(const ray_t& ray) const;
+    void                   query_ray(const ray_t& ray, vector_t<ray_hit_t>& result) const;
+    vector_t<brush_t*>     query_frustum(const mat4_t& view_projection) const;
+    void                   query_frustum(const mat4_t& view_projection, vector_t<brush_t*>& result) const;
+    // the volume at point: the void volume changed by the volume operation
+    // of every brush containing point, in the order rebuild applies them.
+    // points within rebuild's tolerance of a brush's surface may count as
+    // inside or outside of it
+    volume_t               query_volume(const vec3_t& point) const;
+    // query_volume for count points at once. the points are sorted so that
+    // each brush is tested against many nearby points in bulk
+    void                   query_volumes(const vec3_t *points, int count, volume_t *volumes) const;
+    // the world as of the last rebuild, for readers on other threads (see
+    // world_version_t). null if edits are waiting for a rebuild
+    std::shared_ptr<const world_version_t> get_version();
     std::any               userdata;
 
 module_private:
     world_t(const world_t& other) = delete;
     world_t& operator=(const world_t& other) = delete;
-    // todo: implement move constructors
-    world_t(world_t&& other) = delete;
-    world_t& operator=(world_t&& other) = delete;
     brush_t            *sentinel;
-    set_t<brush_t*>    need_face_and_box_rebuild;
-    set_t<brush_t*>    need_fragment_rebuild;
+    // brushes with any need_t flag set, in the order they got the first
+    // one. rebuild sorts them by uid
+    vector_t<brush_t*> dirty_brushes;
+    vector_t<change_t> changes;
+    bool               track_fragment_changes;
+    vector_t<fragment_change_t> fragment_changes;
+    vector_t<brush_t*> removed_brushes;
     volume_t           void_volume;
     int                next_uid;
+    // every distinct plane (up to orientation) used by any brush, indexed
+    // by plane id and stored with a canonical orientation
+    vector_t<plane_t>  plane_table;
+    vector_t<int>      plane_refs;
+    vector_t<int>      free_plane_ids;
+    map_t<std::array<scalar_t, 4>, int> plane_lookup;
+    vector_t<shape_t*> shapes;
+    int                edit_depth;
+    vector_t<brush_t*> edited_brushes;
+};
+
+// an immutable copy of what queries and readers need of a world, made by
+// world_t::get_version. versions share the brushes that no rebuild touched
+// in between, so making one only copies what changed. any number of
+// threads can query a version while the world is edited and rebuilt, and
+// it stays valid as long as someone holds it
+struct world_version_t {
+    csg_replace_new_delete
+    // like the world's queries, the overloads taking a result vector clear
+    // and fill it
+    vector_t<const brush_version_t*> query_point(const vec3_t& point) const;
+    void query_point(const vec3_t& point, vector_t<const brush_version_t*>& result) const;
+    vector_t<const brush_version_t*> query_box(const box_t& box) const;
+    void query_box(const box_t& box, vector_t<const brush_version_t*>& result) const;
+    vector_t<version_ray_hit_t>      query_ray(const ray_t& ray) const;
+    void query_ray(const ray_t& ray, vector_t<version_ray_hit_t>& result) const;
+    vector_t<const brush_version_t*> query_frustum(const mat4_t& view_projection) const;
+    void query_frustum(const mat4_t& view_projection, vector_t<const brush_version_t*>& result) const;
+
+    // in the world's brush order
+    vector_t<std::shared_ptr<const brush_version_t>> brushes;
+    volume_t                void_volume;
+};
+
+enum query_type_t {
+    QUERY_POINT,
+    QUERY_BOX,
+    QUERY_RAY,
+    QUERY_FRUSTUM
+};
+
+/*
+    runs many queries of any type at once. run sorts the point and box
+    queries along a z-order curve and hands them out in chunks of nearby
+    queries, so each chunk only tests the brushes near it, and spreads the
+    chunks over several threads. the results are stored one after another
+    in query order: query i found get_brushes()[offsets[i] .. offsets[i+1])
+    with offsets = get_offsets(), or for a ray get_hits() in the same way
+    with get_hit_offsets(). each query finds what the world's query of the
+    same type would, in the same order
+*/
+struct query_batch_t {
+    csg_replace_new_delete
+    query_batch_t();
+    ~query_batch_t();
+    // threads that run the queries, 0 (the default) uses all hardware threads.
+    // they are started by the first run and wait for the next one until the
+    // batch goes away or the count changes
+    void                   set_thread_count(int thread_count);
+    // the add functions return the index of the query
+    int                    add_point(const vec3_t& point);
+    int                    add_box(const box_t& box);
+    int                    add_ray(const ray_t& ray);
+    int                    add_frustum(const mat4_t& view_projection);
+    // removes all queries and results, keeps the memory for the next batch
+    void                   clear();
+    int                    size() const;
+    query_type_t           get_type(int query) const;
+    // runs every query, replacing the results of the last run. only reads
+    // the world, like the world's queries
+    void                   run(const world_t *world);
+    // size() + 1 entries each, a ray's brush range and the hit range of
+    // any other query are empty
+    const vector_t<int>&       get_offsets() const;
+    const vector_t<brush_t*>&  get_brushes() const;
+    const vector_t<int>&       get_hit_offsets() const;
+    const vector_t<ray_hit_t>& get_hits() const;
+
+module_private:
+    query_batch_t(const query_batch_t& other) = delete;
+    query_batch_t& operator=(const query_batch_t& other) = delete;
+    struct query_t {
+        query_type_t       type;
+        box_t              box;       // the point as an empty box for points
+        ray_t              ray;
+        int                frustum;   // into frustums
+    };
+    // what a thread found for a chunk of queries, copied into the results
+    // once all chunks are done
+    struct chunk_t {
+        int                first, last;  // into order
+        vector_t<brush_t*> brushes;
+        vector_t<ray_hit_t> hits;
+    };
+    struct workers_t;      // the threads kept between runs (query_batch.cpp)
+    int                    thread_count;
+    std::unique_ptr<workers_t> workers;
+    vector_t<query_t>      queries;
+    vector_t<mat4_t>       frustums;
+    vector_t<int>          order;     // queries in the order they run
+    vector_t<chunk_t>      chunks;
+    vector_t<int>          offsets;
+    vector_t<brush_t*>     brushes;
+    vector_t<int>          hit_offsets;
+    vector_t<ray_hit_t>    hits;
+};
+
+// what mesh_t collects into one mesh_group_t
+enum mesh_grouping_t {
+    MESH_GROUP_BY_VOLUMES, // one group per (front_volume, back_volume)
+    MESH_GROUP_BY_BRUSH    // one group per brush
+};
+
+// how mesh_t cuts fragments into triangles
+enum mesh_triangulation_t {
+    MESH_TRIANGULATE_STRIP,      // same as triangulate()
+    MESH_TRIANGULATE_MIN_WEIGHT  // shortest total edge length, fewer slivers
+};
+
+struct mesh_vertex_t {
+    csg_replace_new_delete
+    vec3_t                  position;
+    vec3_t                  normal;
+};
+
+struct mesh_group_t {
+    csg_replace_new_delete
+    // triangles face front_volume and have back_volume behind them, see
+    // mesh_t::set_outside_volume. 0 when grouping by brush
+    volume_t                front_volume;
+    volume_t                back_volume;
+    brush_t                 *brush;     // NULL when grouping by volumes
+    vector_t<mesh_vertex_t> vertices;
+    vector_t<uint32_t>      indices;    // three per triangle, into vertices
+    // set if the last build or update touched the group. a group left
+    // without triangles stays (empty) until the next update
+    bool                    changed;
+
+module_private:
+    std::array<int, 2>      key;
+};
+
+// a mesh_vertex_t in 8 bytes: the position quantized to 16 bits per
+// component within the box of its chunk, the normal octahedral encoded
+struct packed_vertex_t {
+    csg_replace_new_delete
+    uint16_t                position[3];
+    int8_t                  normal[2];
+};
+
+// part of a group with at most 65536 vertices, so its indices fit 16 bits
+struct packed_chunk_t {
+    csg_replace_new_delete
+    int                     group;         // in mesh_t::get_groups
+    box_t                   box;           // of the chunk's vertices
+    uint32_t                first_vertex, vertex_count;
+    uint32_t                first_index, index_count; // relative to first_vertex
+};
+
+// see mesh_t::pack
+struct packed_mesh_t {
+    csg_replace_new_delete
+    vector_t<packed_vertex_t> vertices;
+    vector_t<uint16_t>      indices;
+    vector_t<packed_chunk_t> chunks;
+};
+
+vec3_t unpack_position(const packed_chunk_t& chunk, const packed_vertex_t& vertex);
+vec3_t unpack_normal(const packed_vertex_t& vertex);
+
+// triangles one brush contributes to one group, kept by mesh_t so an update
+// only has to triangulate the brushes that changed
+struct mesh_part_t {
+    csg_replace_new_delete
+    std::array<int, 2>      key;
+    brush_t                 *brush;
+    vector_t<mesh_vertex_t> vertices;
+    vector_t<uint32_t>      indices;
+};
+
+/*
+    indexed triangle meshes of the visible fragments of a world (those with
+    different volumes on either side), grouped by volumes or by brush.
+    vertices shared by fragments of the same face are welded. the groups'
+    buffers are kept and reused between updates, write copies them into
+    memory of the caller's
+*/
+struct mesh_t {
+    csg_replace_new_delete
+    mesh_t(mesh_grouping_t grouping = MESH_GROUP_BY_VOLUMES);
+    // fragments with this volume on their back side are flipped to face it,
+    // all others face their front. defaults to the world's void volume.
+    // like the other settings it applies from the next build
+    void                   set_outside_volume(volume_t outside_volume);
+    void                   set_triangulation(mesh_triangulation_t triangulation);
+    // reorder every group's triangles for the post-transform vertex cache
+    // and its vertices by first use
+    void                   set_optimize_vertex_cache(bool enabled);
+    void                   build(world_t *world);
+    // rebuild only the brushes in changes, as returned by world_t::rebuild
+    // of the world given to build
+    void                   update(const vector_t<change_t>& changes);
+    // by (front_volume, back_volume) or by brush uid
+    const vector_t<mesh_group_t>& get_groups() const;
+    size_t                 get_vertex_count() const;
+    size_t                 get_index_count() const;
+    // copies every group one after another, so the caller's arrays need
+    // get_vertex_count() and get_index_count() elements. indices stay
+    // relative to the first vertex of their group
+    void                   write(mesh_vertex_t *vertices, uint32_t *indices) const;
+    // the groups in a compact form for storing or streaming, well under half
+    // the size. with chunk_size > 0 triangles are also split up by a grid
+    // of that cell size (by their first vertex), which bounds the chunk
+    // boxes and so the quantization error
+    void                   pack(packed_mesh_t& packed, scalar_t chunk_size = 0) const;
+
+module_private:
+    mesh_grouping_t        grouping;
+    mesh_triangulation_t   triangulation;
+    bool                   optimize_vertex_cache;
+    volume_t               outside_volume;
+    bool                   has_outside_volume;
+    world_t                *world;
+    vector_t<mesh_group_t> groups;
+    // parts of every brush by uid, and the uids of the brushes with a part
+    // in each group by group key, so an update only visits the groups of
+    // the brushes that changed
+    map_t<int, vector_t<mesh_part_t>> brush_parts;
+    map_t<std::array<int, 2>, set_t<int>> group_brushes;
+};
+
+/*
+    binary snapshot of a world: its brushes (planes, shapes, transforms,
+    times, volume operations) and optionally the faces, fragments, boxes
+    and intersecting brushes of the last rebuild. the snapshot is a header
+    followed by flat arrays of the records below, which refer to each other
+    by index. every array starts 8 byte aligned, so a snapshot in memory (a
+    mapped file for example) can be read in place through snapshot_t. it is
+    in native byte order and only opens with the same scalar_t it was saved
+    with
+*/
+static constexpr uint32_t snapshot_magic   = 0x47534354; // "TCSG" little endian
+static constexpr uint32_t snapshot_version = 2;
+
+enum snapshot_flags_t {
+    // faces, fragments, boxes and intersecting brushes are included
+    SNAPSHOT_COMPUTED = 1
+};
+
+// the volume operations a snapshot can hold, see save_snapshot
+enum snapshot_operation_t {
+    SNAPSHOT_OPERATION_IDENTITY, // what world_t::add gives a brush
+    SNAPSHOT_OPERATION_FILL,     // make_fill_operation(volume_to)
+    SNAPSHOT_OPERATION_CONVERT   // make_convert_operation(volume_from, volume_to)
+};
+
+// where the planes of a snapshot_shape_t came from
+enum snapshot_shape_kind_t {
+    SNAPSHOT_SHAPE_OWN,     // set_planes of a brush that has a transform
+    SNAPSHOT_SHAPE_SHARED,  // world_t::add_shape
+    SNAPSHOT_SHAPE_REMOVED  // shared, but only kept alive by its brushes
+};
+
+struct snapshot_header_t {
+    uint32_t                magic;
+    uint32_t                version;
+    uint32_t                scalar_size;  // sizeof(scalar_t)
+    uint32_t                flags;        // snapshot_flags_t
+    volume_t                void_volume;
+    int32_t                 next_uid;
+    uint32_t                brush_count;
+    uint32_t                plane_count;
+    // the arrays below are empty without SNAPSHOT_COMPUTED
+    uint32_t                face_count;   // = plane_count, face i is on plane i
+    uint32_t                fragment_count;
+    uint32_t                vertex_count;
+    uint32_t                vertex_face_count;
+    uint32_t                intersecting_count;
+    uint32_t                shape_count;
+    uint32_t                shape_plane_count;
+    uint32_t                padding;
+    // offsets of the arrays from the start of the snapshot
+    uint64_t                brushes, planes, faces, fragments;
+    uint64_t                vertices, vertex_faces, intersecting;
+    uint64_t                shapes, shape_planes;
+    uint64_t                size;         // of the whole snapshot
+};
+
+struct snapshot_brush_t {
+    int32_t                 uid;
+    int32_t                 time;
+    int32_t                 planes_version; // keeps fragment ids stable
+    int32_t                 operation;      // snapshot_operation_t
+    volume_t                volume_from, volume_to;
+    uint32_t                first_plane, plane_count; // also its faces
+    uint32_t                first_intersecting, intersecting_count;
+    // the planes are those of the shape moved by transform, shape is -1 for
+    // planes of its own without a transform
+    int32_t                 shape;
+    int32_t                 padding;
+    box_t                   box;
+    mat4_t                  transform;
+};
+
+struct snapshot_shape_t {
+    int32_t                 kind;           // snapshot_shape_kind_t
+    uint32_t                first_plane, plane_count; // in shape_planes
+};
+
+struct snapshot_face_t {
+    uint32_t                first_vertex, vertex_count;
+    uint32_t                first_fragment, fragment_count;
+};
+
+struct snapshot_fragment_t {
+    uint64_t                id;
+    uint32_t                first_vertex, vertex_count;
+    volume_t                front_volume, back_volume;
+    int32_t                 front_brush, back_brush; // brush index, front can be -1
+};
+
+struct snapshot_vertex_t {
+    vec3_t                  position;
+    // vertex_t::faces as face indices, these can be faces of other brushes
+    uint32_t                first_face, face_count;
+};
+
+// arrays of a snapshot in memory, it is not copied. vertex_faces are face
+// indices and intersecting are brush indices
+struct snapshot_t {
+    csg_replace_new_delete
+    const snapshot_header_t   *header;
+    const snapshot_brush_t    *brushes;
+    const plane_t             *planes;
+    const snapshot_face_t     *faces;
+    const snapshot_fragment_t *fragments;
+    const snapshot_vertex_t   *vertices;
+    const uint32_t            *vertex_faces;
+    const uint32_t            *intersecting;
+    const snapshot_shape_t    *shapes;
+    const plane_t             *shape_planes;
+};
+
+// flags is SNAPSHOT_COMPUTED or 0. fails (leaving data empty) for brushes
+// with volume operations other than the ones of snapshot_operation_t, and
+// with SNAPSHOT_COMPUTED for worlds changed since the last rebuild. what
+// rebuild only keeps to speed up later rebuilds (the carved pieces of each
+// face, the faces of shapes) is not saved
+bool save_snapshot(world_t *world, int flags, vector_t<uint8_t>& data);
+// checks the header and every index, so reading the snapshot through the
+// returned arrays stays in bounds, and that the records fit together the
+// way save_snapshot lays them out. nothing is copied. fails for other
+// versions or scalar_t
+bool open_snapshot(const void *data, size_t size, snapshot_t& snapshot);
+// copies the snapshot's brushes and shapes into an empty world (outside
+// begin_edit/end_edit), with the same uids. with SNAPSHOT_COMPUTED the
+// world is rebuilt as it was saved and the next rebuild reports no
+// changes, otherwise the next rebuild builds every brush. either way the
+// first rebuild after an edit carves the faces it touches from scratch
+bool load_snapshot(world_t *world, const snapshot_t& snapshot);
+
+// an entity of a .map file with the brushes map_importer_t added for it
+struct map_entity_t {
+    csg_replace_new_delete
+    vector_t<std::pair<std::string, std::string>> properties; // in file order
+    vector_t<brush_t*>      brushes;
+};
+
+// gives the volume operation for the brushes of an entity, called once per
+// entity before its first brush is added
+using map_entity_operation_t = std::function<volume_operation_t(const map_entity_t&)>;
+
+struct map_import_stats_t {
+    csg_replace_new_delete
+    size_t                  bytes;
+    int                     entities;
+    int                     brushes;
+    int                     planes;
+    int                     skipped_brushes; // patches and other non-plane brushes
+    int                     skipped_planes;  // with collinear points
+    double                  parse_seconds;   // finding and parsing brushes
+    double                  add_seconds;     // adding them to the world
+    double                  total_seconds;   // from the first feed to finish
+    double                  megabytes_per_second;
+};
+
+/*
+    reads Quake and Valve 220 .map files into a world. the text can be fed
+    in pieces of any size (import_file reads in blocks), complete brushes
+    are parsed in batches spread over several threads and added to the
+    world in file order, so only a batch of brushes is kept in memory.
+    faces are expected one per line, as every editor writes them, the
+    texture information after the three points is skipped
+*/
+struct map_importer_t {
+    csg_replace_new_delete
+    map_importer_t(world_t *world);
+    // threads that parse a batch, 0 (the default) uses all hardware threads
+    void                   set_thread_count(int thread_count);
+    // without one the brushes keep the operation world_t::add gives them
+    void                   set_entity_operation(const map_entity_operation_t& entity_operation);
+    // both return false once there was an error, see get_error
+    bool                   feed(const char *text, size_t size);
+    bool                   finish();
+    // feeds the whole file and finishes
+    bool                   import_file(const char *path);
+    const char             *get_error() const;
+    const vector_t<map_entity_t>& get_entities() const;
+    const map_import_stats_t& get_stats() const;
+
+module_private:
+    // a brush found by the scanner, as offsets into buffer
+    struct pending_brush_t {
+        size_t             begin, end;
+        int                entity;
+    };
+    world_t                *world;
+    int                    thread_count;
+    map_entity_operation_t entity_operation;
+    vector_t<map_entity_t> entities;
+    vector_t<volume_operation_t> entity_operations;
+    vector_t<char>         buffer;
+    size_t                 scan;      // in buffer, everything before was scanned
+    int                    depth;     // 0 between entities, 1 inside one
+    size_t                 line;      // lines discarded from the front of buffer
+    vector_t<pending_brush_t> pending;
+    std::string            error;
+    map_import_stats_t     stats;
+    bool                   started;
+    std::chrono::steady_clock::time_point start_time;
 };
 
 } // end namespace csg
@@ -1,3 +1,120 @@
 #pragma once
 #define module_private public
 #include "csg.hpp"
+
+namespace csg {
+
+enum relation_t {
+    RELATION_FRONT,
+    RELATION_OUTSIDE = RELATION_FRONT,
+    RELATION_BACK,
+    RELATION_INSIDE = RELATION_BACK,
+    RELATION_ALIGNED,
+    RELATION_REVERSE_ALIGNED,
+    RELATION_SPLIT
+};
+
+// what world_t::rebuild has to do for a brush, flags in brush_t::needs
+enum need_t {
+    NEED_FACE_AND_BOX_REBUILD = 1,
+    NEED_FACE_TRANSFORM       = 2,
+    NEED_FRAGMENT_REBUILD     = 4
+};
+
+// what make_fill_operation and make_convert_operation return, so their
+// volumes can be read back from a volume_operation_t (see save_snapshot)
+struct fill_operation_t {
+    volume_t with;
+    volume_t operator()(volume_t) const { return with; }
+};
+
+struct convert_operation_t {
+    volume_t from, to;
+    volume_t operator()(volume_t old) const { return (old == from)? to: old; }
+};
+
+// does brush0 come before brush1 in the csg order, the order rebuild
+// applies volume operations in? (see rebuild.cpp)
+bool b0_before_b1(const brush_t* b0, const brush_t* b1);
+
+// sets flags in brush->needs, adding the brush to world_t::dirty_brushes
+// if it had none
+void mark_needs(brush_t *brush, int needs);
+
+// face level dirty tracking (see brush_t::dirty_boxes), both also queue
+// the brush for rebuild_fragments
+void mark_faces_dirty(brush_t *brush, const box_t& region);
+void mark_all_faces_dirty(brush_t *brush);
+
+// what a setter changed about a brush, collected in brush_t::pending_edits
+// between world_t::begin_edit and end_edit
+enum edit_t {
+    EDIT_PLANES    = 1, // faces have to be built again
+    EDIT_TRANSFORM = 2, // faces only have to be moved
+    EDIT_VOLUMES   = 4  // volume operation or time changed
+};
+
+// turns the edits collected since begin_edit into dirty marks, also done
+// at the start of world_t::rebuild
+void apply_pending_edits(world_t *world);
+
+// sets up what rebuild_faces_and_box caches besides the faces and box, for
+// a brush whose faces were filled in some other way (see load_snapshot)
+void cache_face_planes(brush_t *brush);
+
+// planes stored as structure of arrays so they can be tested in bulk,
+// each component array is padded up to a multiple of plane_soa_width
+static constexpr int plane_soa_width = 8;
+
+int  plane_soa_stride(int plane_count);
+void make_plane_soa(const vector_t<plane_t>& planes, vector_t<scalar_t>& soa);
+
+// classify count points (given as separate x/y/z arrays) against a plane,
+// writing RELATION_FRONT, RELATION_BACK or RELATION_ALIGNED for each point
+void classify_points(const plane_t& plane,
+                     const scalar_t *x, const scalar_t *y, const scalar_t *z,
+                     int count, relation_t *relations);
+
+// classify a point against all planes of a convex polyhedron (see
+// make_plane_soa), returns RELATION_OUTSIDE if the point is in front of any
+// plane, RELATION_ALIGNED if it lies on any plane and RELATION_INSIDE otherwise
+relation_t classify_point(const vec3_t& point,
+                          const scalar_t *plane_soa, int plane_count);
+
+// position of point along a z-order curve through bounds, with 10 bits
+// per axis. sorting by it puts points close to each other next to each
+// other (see query_batch_t)
+uint32_t morton_code(const vec3_t& point, const box_t& bounds);
+
+#ifdef CSG_EXACT_PLANES
+/*
+    exact plane mode: normals are snapped to multiples of 1/exact_normal_grid
+    and offsets to multiples of 1/exact_offset_grid, so every plane is
+    (a,b,c,e)/exact_normal_grid with integer a,b,c,e. the intersection of
+    three such planes is a rational point and its relation to any other plane
+    can be decided exactly. |a|,|b|,|c| <= exact_normal_grid, so 64 bit
+    cross products and 128 bit predicates don't overflow for offsets up to
+    about 2^24. that is the bound with double scalar_t; a float only holds
+    every multiple of 1/exact_offset_grid below 2^16, larger offsets end up
+    on the coarser float spacing (still a multiple, so this stays exact).
+*/
+static constexpr scalar_t exact_normal_grid = 4096;
+static constexpr scalar_t exact_offset_grid = 256;
+
+plane_t snap_plane(const plane_t& plane);
+
+__extension__ typedef __int128 int128_t;
+
+// homogeneous point (x/w, y/w, z/w), w > 0
+struct exact_point_t {
+    int128_t x, y, z, w;
+};
+
+bool       try_make_exact_point(const plane_t& p0, const plane_t& p1, const plane_t& p2,
+                                exact_point_t& point);
+relation_t classify_exact(const exact_point_t& point, const plane_t& plane);
+bool       exact_equal(const exact_point_t& a, const exact_point_t& b);
+vec3_t     to_vec3(const exact_point_t& point);
+#endif
+
+}
@@ -95,42 +95,15 @@ struct cube_brush_userdata_t {
         return transform;
     }
 
-    void update_display_list() {
+    void update_display_list(const mesh_group_t& group) {
         glNewList(display_list, GL_COMPILE);
-
-        auto faces = brush->get_faces();
-        for (face_t& face: faces) {
-            glBegin(GL_TRIANGLES);
-            for (fragment_t& fragment: face.fragments) {
-                if (fragment.back_volume == fragment.front_volume) {
-                    continue;
-                }
-
-                const vector<vertex_t>& vertices = fragment.vertices;
-
-                vec3 normal = face.plane->normal;
-                bool flip_face = fragment.back_volume == AIR;
-                if (flip_face) {
-                    normal = -normal;
-                }
-
-                glNormal3fv(value_ptr(normal));
-
-                vector<triangle_t> tris = triangulate(fragment);
-                for (triangle_t& tri: tris) {
-                    if (flip_face) {
-                        glVertex3fv(value_ptr(vertices[tri.i].position));
-                        glVertex3fv(value_ptr(vertices[tri.k].position));
-                        glVertex3fv(value_ptr(vertices[tri.j].position));
-                    } else {
-                        glVertex3fv(value_ptr(vertices[tri.i].position));
-                        glVertex3fv(value_ptr(vertices[tri.j].position));
-                        glVertex3fv(value_ptr(vertices[tri.k].position));
-                    }
-                }
-            }
-            glEnd();
+        glBegin(GL_TRIANGLES);
+        for (uint32_t index: group.indices) {
+            const mesh_vertex_t& vertex = group.vertices[index];
+            glNormal3fv(value_ptr(vertex.normal));
+            glVertex3fv(value_ptr(vertex.position));
         }
+        glEnd();
         glEndList();
     }
 
@@ -319,6 +292,22 @@ int main(int, char**) {
         );    
     }
 
+    /*
+        one mesh per brush, faces point into the air
+    */
+    mesh_t mesh(MESH_GROUP_BY_BRUSH);
+    mesh.set_outside_volume(AIR);
+    world.rebuild();
+    mesh.build(&world);
+
+    auto update_display_lists = [&]() {
+        for (const mesh_group_t& group: mesh.get_groups()) {
+            if (group.changed)
+                any_cast<cube_brush_userdata_t>(&group.brush->userdata)->update_display_list(group);
+        }
+    };
+    update_display_lists();
+
     /*
         main loop
     */
@@ -363,9 +352,8 @@ int main(int, char**) {
 
         // rebuild the world and update display list for any rebuilt brush
         // ---------------------------------------
-        auto rebuilt = world.rebuild();   
-        for (brush_t* b: rebuilt)
-            any_cast<cube_brush_userdata_t>(&b->userdata)->update_display_list();        
+        mesh.update(world.rebuild());
+        update_display_lists();
         // ---------------------------------------
 
         // update camera
@@ -0,0 +1,97 @@
+#include "csg_private.hpp"
+
+#ifdef CSG_EXACT_PLANES
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#error "CSG_EXACT_PLANES needs __int128"
+#endif
+
+#include <math.h>
+#include <stdint.h>
+
+namespace csg {
+
+struct exact_plane_t {
+    int64_t a, b, c, e;
+};
+
+static int64_t snapped(scalar_t x, scalar_t grid) {
+    return int64_t(llround(double(x) * double(grid)));
+}
+
+// with float scalar_t the offset keeps the 1/256 grid only below 2^16,
+// past that the division rounds it to the float spacing (see csg_private.hpp)
+plane_t snap_plane(const plane_t& plane) {
+    return plane_t{
+        vec3_t(
+            scalar_t(snapped(plane.normal.x, exact_normal_grid)) / exact_normal_grid,
+            scalar_t(snapped(plane.normal.y, exact_normal_grid)) / exact_normal_grid,
+            scalar_t(snapped(plane.normal.z, exact_normal_grid)) / exact_normal_grid
+        ),
+        scalar_t(snapped(plane.offset, exact_offset_grid)) / exact_offset_grid
+    };
+}
+
+// integer coefficients of a snapped plane, all scaled by exact_normal_grid
+// (the conversion is exact because the plane was snapped by set_planes)
+static exact_plane_t to_exact(const plane_t& plane) {
+    return exact_plane_t{
+        snapped(plane.normal.x, exact_normal_grid),
+        snapped(plane.normal.y, exact_normal_grid),
+        snapped(plane.normal.z, exact_normal_grid),
+        snapped(plane.offset,   exact_normal_grid)
+    };
+}
+
+bool try_make_exact_point(const plane_t& plane0, const plane_t& plane1, const plane_t& plane2,
+                          exact_point_t& point)
+{
+    // same formula as try_make_vertex in rebuild.cpp, just without rounding:
+    // x = -(e0 (n1 x n2) + e1 (n2 x n0) + e2 (n0 x n1)) / (n0 . (n1 x n2))
+    exact_plane_t p0 = to_exact(plane0);
+    exact_plane_t p1 = to_exact(plane1);
+    exact_plane_t p2 = to_exact(plane2);
+
+    int64_t c12[3] = { p1.b*p2.c - p1.c*p2.b, p1.c*p2.a - p1.a*p2.c, p1.a*p2.b - p1.b*p2.a };
+    int64_t c20[3] = { p2.b*p0.c - p2.c*p0.b, p2.c*p0.a - p2.a*p0.c, p2.a*p0.b - p2.b*p0.a };
+    int64_t c01[3] = { p0.b*p1.c - p0.c*p1.b, p0.c*p1.a - p0.a*p1.c, p0.a*p1.b - p0.b*p1.a };
+
+    int128_t w = int128_t(p0.a)*c12[0] + int128_t(p0.b)*c12[1] + int128_t(p0.c)*c12[2];
+    if (w == 0)
+        return false;
+
+    int128_t xyz[3];
+    for (int i=0; i<3; ++i)
+        xyz[i] = -(int128_t(p0.e)*c12[i] + int128_t(p1.e)*c20[i] + int128_t(p2.e)*c01[i]);
+
+    int128_t sign = (w < 0)? -1: 1;
+    point = exact_point_t{ sign*xyz[0], sign*xyz[1], sign*xyz[2], sign*w };
+    return true;
+}
+
+relation_t classify_exact(const exact_point_t& point, const plane_t& plane) {
+    // sign of n.(x/w) + e, multiplied through by w > 0
+    exact_plane_t p = to_exact(plane);
+    int128_t d = p.a*point.x + p.b*point.y + p.c*point.z + p.e*point.w;
+    if (d > 0)
+        return RELATION_FRONT;
+    else if (d < 0)
+        return RELATION_BACK;
+    else
+        return RELATION_ALIGNED;
+}
+
+bool exact_equal(const exact_point_t& a, const exact_point_t& b) {
+    return a.x*b.w == b.x*a.w &&
+           a.y*b.w == b.y*a.w &&
+           a.z*b.w == b.z*a.w;
+}
+
+vec3_t to_vec3(const exact_point_t& point) {
+    double w = double(point.w);
+    return vec3_t(double(point.x) / w, double(point.y) / w, double(point.z) / w);
+}
+
+}
+
+#endif // CSG_EXACT_PLANES
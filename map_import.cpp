@@ -0,0 +1,470 @@
+#include "csg_private.hpp"
+#include <algorithm>
+#include <charconv>
+#include <thread>
+
+#include <stdio.h>
+#include <string.h>
+
+namespace csg {
+
+using import_clock = std::chrono::steady_clock;
+
+// brushes scanned before they are parsed and added together
+static constexpr size_t batch_brushes = 16384;
+// a thread gets at least this many brushes of a batch
+static constexpr size_t min_thread_brushes = 512;
+static constexpr size_t file_block_size = 1 << 20;
+
+static double seconds_since(import_clock::time_point start) {
+    return std::chrono::duration<double>(import_clock::now() - start).count();
+}
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static const char *skip_space(const char *p, const char *end) {
+    while (p < end && is_space(*p))
+        ++p;
+    return p;
+}
+
+static bool is_comment(const char *p, const char *end) {
+    return end - p >= 2 && p[0] == '/' && p[1] == '/';
+}
+
+static const char *skip_space_and_comments(const char *p, const char *end) {
+    for (;;) {
+        p = skip_space(p, end);
+        if (!is_comment(p, end))
+            return p;
+        const char *newline = static_cast<const char*>(memchr(p, '\n', end - p));
+        p = newline? newline + 1: end;
+    }
+}
+
+static const char *skip_token(const char *p, const char *end) {
+    while (p < end && !is_space(*p))
+        ++p;
+    return p;
+}
+
+static const char *skip_blanks(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        ++p;
+    return p;
+}
+
+/*
+    skips the texture name and alignment after the points of a face, up to
+    the end of the line. the texture name is one token whatever it contains
+    (braces included), after it a comment or a '}' ends the face early
+*/
+static const char *skip_face_texture(const char *p, const char *end) {
+    p = skip_blanks(p, end);
+    if (p < end && *p != '\n')
+        p = skip_token(p, end);
+    // usual case, nothing but numbers up to the end of the line
+    const char *newline = static_cast<const char*>(memchr(p, '\n', end - p));
+    const char *line_end = newline? newline: end;
+    if (!memchr(p, '}', line_end - p) && !memchr(p, '/', line_end - p))
+        return line_end;
+    for (;;) {
+        p = skip_blanks(p, end);
+        if (p == end || *p == '\n' || *p == '}' || is_comment(p, end))
+            return p;
+        p = skip_token(p, end);
+    }
+}
+
+/*
+    the '}' closing the brush whose faces start at p, going over the faces
+    the way parse_brush does, but without parsing their points. null if the
+    text ends first
+*/
+static const char *find_brush_end(const char *p, const char *end) {
+    for (;;) {
+        p = skip_space_and_comments(p, end);
+        if (p == end)
+            return nullptr;
+        if (*p == '}')
+            return p;
+        for (int i=0; i<3; ++i) {
+            p = skip_space(p, end);
+            if (p == end || *p != '(')
+                break; // not a face, parse_brush reports it
+            const char *close = static_cast<const char*>(memchr(p, ')', end - p));
+            if (!close)
+                return nullptr;
+            p = close + 1;
+        }
+        p = skip_face_texture(p, end);
+        if (p == end)
+            return nullptr;
+    }
+}
+
+/*
+    plane of a face given by three points on it (as written by quake's
+    qbsp), facing out of the brush. computed in double, map coordinates
+    are usually integers and the cross product of their differences is
+    then exact
+*/
+static bool make_map_plane(const glm::dvec3 points[3], plane_t& plane) {
+    glm::dvec3 normal = glm::cross(points[0] - points[1], points[2] - points[1]);
+    double length = glm::length(normal);
+    if (!(length > 0))
+        return false;
+    normal /= length;
+    plane = plane_t{ vec3_t(normal), scalar_t(-glm::dot(points[1], normal)) };
+    return true;
+}
+
+// planes of the brushes of one part of a batch
+struct parsed_brushes_t {
+    vector_t<plane_t>       planes;
+    vector_t<uint32_t>      plane_counts;
+    int                     skipped_planes = 0;
+    const char              *error = nullptr;
+    size_t                  error_offset = 0;
+};
+
+static const char *parse_point(const char *p, const char *end, glm::dvec3& point) {
+    p = skip_space(p, end);
+    if (p == end || *p != '(')
+        return nullptr;
+    ++p;
+    for (int axis=0; axis<3; ++axis) {
+        p = skip_space(p, end);
+        auto result = std::from_chars(p, end, point[axis]);
+        if (result.ec != std::errc())
+            return nullptr;
+        p = result.ptr;
+    }
+    p = skip_space(p, end);
+    if (p == end || *p != ')')
+        return nullptr;
+    return p + 1;
+}
+
+static bool parse_brush(const char *text, size_t begin, size_t end, parsed_brushes_t& parsed) {
+    uint32_t plane_count = 0;
+    const char *p = text + begin;
+    const char *brush_end = text + end;
+    for (;;) {
+        p = skip_space_and_comments(p, brush_end);
+        if (p == brush_end)
+            break;
+        glm::dvec3 points[3];
+        const char *face_start = p;
+        for (int i=0; i<3 && p; ++i)
+            p = parse_point(p, brush_end, points[i]);
+        if (!p) {
+            parsed.error = "expected a face, ( x y z ) ( x y z ) ( x y z ) texture ...";
+            parsed.error_offset = face_start - text;
+            return false;
+        }
+        plane_t plane;
+        if (make_map_plane(points, plane)) {
+            parsed.planes.push_back(plane);
+            plane_count += 1;
+        } else {
+            parsed.skipped_planes += 1;
+        }
+        p = skip_face_texture(p, brush_end);
+    }
+    parsed.plane_counts.push_back(plane_count);
+    return true;
+}
+
+map_importer_t::map_importer_t(world_t *world) {
+    this->world = world;
+    thread_count = 0;
+    scan = 0;
+    depth = 0;
+    line = 1;
+    started = false;
+    memset(&stats, 0, sizeof(stats));
+}
+
+void map_importer_t::set_thread_count(int thread_count) {
+    this->thread_count = thread_count;
+}
+
+void map_importer_t::set_entity_operation(const map_entity_operation_t& entity_operation) {
+    this->entity_operation = entity_operation;
+}
+
+static void set_error(map_importer_t *importer, size_t offset, const char *message) {
+    // line of offset in the buffer
+    const char *text = importer->buffer.data();
+    size_t line = importer->line + std::count(text, text + offset, '\n');
+    importer->error = "line " + std::to_string(line) + ": " + message;
+}
+
+static bool add_pending(map_importer_t *importer) {
+    // parses the pending brushes (in parts on several threads) and adds
+    // them to the world in file order
+    auto& pending = importer->pending;
+    if (pending.empty())
+        return true;
+    map_import_stats_t& stats = importer->stats;
+
+    size_t thread_count = importer->thread_count > 0? importer->thread_count:
+        std::max(1u, std::thread::hardware_concurrency());
+    size_t part_count = std::min(thread_count, (pending.size() + min_thread_brushes - 1) / min_thread_brushes);
+    vector_t<parsed_brushes_t> parts(part_count);
+    auto parse_part = [&](size_t part) {
+        size_t first = pending.size() * part / part_count;
+        size_t last = pending.size() * (part + 1) / part_count;
+        for (size_t i=first; i<last; ++i) {
+            if (!parse_brush(importer->buffer.data(), pending[i].begin, pending[i].end, parts[part]))
+                return;
+        }
+    };
+    vector_t<std::thread> threads;
+    for (size_t part=1; part<part_count; ++part)
+        threads.emplace_back(parse_part, part);
+    parse_part(0);
+    for (std::thread& thread: threads)
+        thread.join();
+
+    for (const parsed_brushes_t& part: parts) {
+        stats.skipped_planes += part.skipped_planes;
+        if (part.error) {
+            set_error(importer, part.error_offset, part.error);
+            return false;
+        }
+    }
+
+    import_clock::time_point add_start = import_clock::now();
+    world_t *world = importer->world;
+    auto& entities = importer->entities;
+    auto& operations = importer->entity_operations;
+    vector_t<plane_t> planes;
+    vector_t<int> plane_counts;
+    vector_t<volume_operation_t> brush_operations;
+    size_t plane_total = 0;
+    for (const parsed_brushes_t& part: parts)
+        plane_total += part.planes.size();
+    planes.reserve(plane_total);
+    plane_counts.reserve(pending.size());
+    brush_operations.reserve(pending.size());
+    size_t index = 0;
+    for (const parsed_brushes_t& part: parts) {
+        planes.insert(planes.end(), part.planes.begin(), part.planes.end());
+        for (uint32_t plane_count: part.plane_counts) {
+            // the brushes of an entity are next to each other, the operation
+            // is asked for before the first one is added
+            int entity = pending[index].entity;
+            bool first = entities[entity].brushes.empty() && (index == 0 || pending[index - 1].entity != entity);
+            if (importer->entity_operation && first)
+                operations[entity] = importer->entity_operation(entities[entity]);
+            plane_counts.push_back(int(plane_count));
+            if (operations[entity])
+                brush_operations.push_back(operations[entity]);
+            else
+                brush_operations.push_back(std::identity{});
+            index += 1;
+        }
+    }
+    vector_t<brush_t*> brushes(pending.size());
+    world->add_many(int(pending.size()), planes.data(), plane_counts.data(),
+                    brush_operations.data(), nullptr, brushes.data());
+    for (size_t i=0; i<pending.size(); ++i)
+        entities[pending[i].entity].brushes.push_back(brushes[i]);
+    stats.brushes += pending.size();
+    stats.planes += planes.size();
+    pending.clear();
+    stats.add_seconds += seconds_since(add_start);
+    return true;
+}
+
+// index of the quote closing the string starting at begin, or size
+static size_t string_end(const vector_t<char>& buffer, size_t begin) {
+    const char *p = static_cast<const char*>(memchr(buffer.data() + begin, '"', buffer.size() - begin));
+    return p? p - buffer.data(): buffer.size();
+}
+
+// index after the block starting with the brace at begin, 0 if it isn't
+// complete yet
+static size_t block_end(const vector_t<char>& buffer, size_t begin) {
+    int depth = 0;
+    for (size_t i=begin; i<buffer.size(); ++i) {
+        if (buffer[i] == '{') {
+            depth += 1;
+        } else if (buffer[i] == '}') {
+            if (--depth == 0)
+                return i + 1;
+        }
+    }
+    return 0;
+}
+
+static bool scan_buffer(map_importer_t *importer, bool final) {
+    /*
+        finds the properties and brushes of entities in the buffer, as far
+        as they are complete. brushes are only remembered for add_pending.
+        the structure is
+
+        { "key" "value" ... { ( x y z ) ( x y z ) ( x y z ) texture ... } ... }
+    */
+    const vector_t<char>& buffer = importer->buffer;
+    const char *text = buffer.data();
+    const char *end = text + buffer.size();
+    size_t size = buffer.size();
+    for (;;) {
+        if (importer->pending.size() >= batch_brushes && !add_pending(importer))
+            return false;
+
+        size_t p = skip_space(text + importer->scan, end) - text;
+        if (p == size) {
+            importer->scan = p;
+            break;
+        }
+        if (buffer[p] == '/') {
+            if (p + 1 == size && !final)
+                break; // maybe a comment, wait for more
+            if (p + 1 < size && buffer[p + 1] == '/') {
+                const char *newline = static_cast<const char*>(memchr(text + p, '\n', size - p));
+                if (!newline && !final)
+                    break;
+                importer->scan = newline? newline + 1 - text: size;
+                continue;
+            }
+        }
+
+        char c = buffer[p];
+        if (importer->depth == 0) {
+            if (c != '{') {
+                set_error(importer, p, "expected '{' starting an entity");
+                return false;
+            }
+            importer->entities.emplace_back();
+            importer->entity_operations.emplace_back();
+            importer->depth = 1;
+            importer->scan = p + 1;
+        } else if (c == '"') {
+            size_t key_end = string_end(buffer, p + 1);
+            size_t value_begin = key_end < size? skip_space(text + key_end + 1, end) - text: size;
+            if (value_begin < size && buffer[value_begin] != '"') {
+                set_error(importer, value_begin, "expected '\"' starting a property value");
+                return false;
+            }
+            size_t value_end = value_begin < size? string_end(buffer, value_begin + 1): size;
+            if (value_end == size) {
+                if (!final)
+                    break;
+                set_error(importer, p, "incomplete property");
+                return false;
+            }
+            importer->entities.back().properties.emplace_back(
+                std::string(text + p + 1, text + key_end),
+                std::string(text + value_begin + 1, text + value_end)
+            );
+            importer->scan = value_end + 1;
+        } else if (c == '{') {
+            size_t body = skip_space_and_comments(text + p + 1, end) - text;
+            if (body == size && !final)
+                break;
+            if (body < size && buffer[body] == '(') {
+                const char *close = find_brush_end(text + body, end);
+                if (!close) {
+                    if (!final)
+                        break;
+                    set_error(importer, p, "incomplete brush");
+                    return false;
+                }
+                importer->pending.push_back({ body, size_t(close - text), int(importer->entities.size()) - 1 });
+                importer->scan = close + 1 - text;
+            } else {
+                // patches, brushDef and the like nest further blocks
+                size_t after = block_end(buffer, p);
+                if (after == 0) {
+                    if (!final)
+                        break;
+                    set_error(importer, p, "incomplete brush");
+                    return false;
+                }
+                importer->stats.skipped_brushes += 1;
+                importer->scan = after;
+            }
+        } else if (c == '}') {
+            importer->depth = 0;
+            importer->scan = p + 1;
+        } else {
+            set_error(importer, p, "expected a property, a brush or '}'");
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool scan_and_add(map_importer_t *importer, bool final) {
+    if (!importer->started) {
+        importer->start_time = import_clock::now();
+        importer->started = true;
+    }
+    import_clock::time_point start = import_clock::now();
+    double add_seconds = importer->stats.add_seconds;
+    bool ok = scan_buffer(importer, final) && add_pending(importer);
+    // add_pending counts its own time
+    importer->stats.parse_seconds += seconds_since(start) - (importer->stats.add_seconds - add_seconds);
+    return ok;
+}
+
+bool map_importer_t::feed(const char *text, size_t size) {
+    if (!error.empty())
+        return false;
+    // whatever was scanned is done with, nothing is pending between feeds
+    line += std::count(buffer.begin(), buffer.begin() + scan, '\n');
+    buffer.erase(buffer.begin(), buffer.begin() + scan);
+    scan = 0;
+    buffer.insert(buffer.end(), text, text + size);
+    stats.bytes += size;
+    return scan_and_add(this, false);
+}
+
+bool map_importer_t::finish() {
+    if (!error.empty())
+        return false;
+    bool ok = scan_and_add(this, true);
+    if (ok && depth != 0) {
+        set_error(this, buffer.size(), "unexpected end of file inside an entity");
+        ok = false;
+    }
+    stats.entities = int(entities.size());
+    stats.total_seconds = seconds_since(start_time);
+    stats.megabytes_per_second = stats.total_seconds > 0? stats.bytes / 1e6 / stats.total_seconds: 0;
+    return ok;
+}
+
+bool map_importer_t::import_file(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        error = std::string("can't open ") + path;
+        return false;
+    }
+    vector_t<char> block(file_block_size);
+    bool ok = true;
+    size_t size;
+    while (ok && (size = fread(block.data(), 1, block.size(), file)) > 0)
+        ok = feed(block.data(), size);
+    fclose(file);
+    return ok && finish();
+}
+
+const char *map_importer_t::get_error() const {
+    return error.empty()? nullptr: error.c_str();
+}
+
+const vector_t<map_entity_t>& map_importer_t::get_entities() const {
+    return entities;
+}
+
+const map_import_stats_t& map_importer_t::get_stats() const {
+    return stats;
+}
+
+}
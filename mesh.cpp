@@ -0,0 +1,412 @@
+#include "csg_private.hpp"
+#include <algorithm>
+
+#include <math.h>
+
+namespace csg {
+
+using mesh_key_t = std::array<int, 2>;
+
+// (part index * 2 + flipped, position), only vertices of the same face with
+// the same normal are welded
+using weld_key_t = std::pair<int, std::array<scalar_t, 3>>;
+
+mesh_t::mesh_t(mesh_grouping_t grouping) {
+    this->grouping = grouping;
+    triangulation = MESH_TRIANGULATE_STRIP;
+    optimize_vertex_cache = false;
+    outside_volume = 0;
+    has_outside_volume = false;
+    world = NULL;
+}
+
+void mesh_t::set_outside_volume(volume_t outside_volume) {
+    this->outside_volume = outside_volume;
+    has_outside_volume = true;
+}
+
+void mesh_t::set_triangulation(mesh_triangulation_t triangulation) {
+    this->triangulation = triangulation;
+}
+
+void mesh_t::set_optimize_vertex_cache(bool enabled) {
+    optimize_vertex_cache = enabled;
+}
+
+// larger fragments are cut the same way as triangulate() does
+static constexpr int max_min_weight_vertices = 32;
+
+// minimum weight triangulation of a convex polygon by dynamic programming
+// over its sub-polygons i..j, where cost[i][j] is the total length of the
+// diagonals used inside i..j
+static triangle_t *triangulate_min_weight(const fragment_t& fragment, triangle_t *out) {
+    int n = fragment.vertices.size();
+    if (n <= 3 || n > max_min_weight_vertices)
+        return triangulate(fragment, out);
+
+    auto length = [&](int a, int b) {
+        return glm::distance(glm::dvec3(fragment.vertices[a].position),
+                             glm::dvec3(fragment.vertices[b].position));
+    };
+    double cost[max_min_weight_vertices][max_min_weight_vertices];
+    int split[max_min_weight_vertices][max_min_weight_vertices];
+    for (int i=0; i+1<n; ++i)
+        cost[i][i+1] = 0;
+    for (int gap=2; gap<n; ++gap) {
+        for (int i=0; i+gap<n; ++i) {
+            int j = i + gap;
+            cost[i][j] = INFINITY;
+            for (int k=i+1; k<j; ++k) {
+                double c = cost[i][k] + cost[k][j];
+                if (k - i > 1) c += length(i, k);
+                if (j - k > 1) c += length(k, j);
+                if (c < cost[i][j]) {
+                    cost[i][j] = c;
+                    split[i][j] = k;
+                }
+            }
+        }
+    }
+
+    // every (i,j) is an edge of a triangle (i,k,j), in polygon order so the
+    // winding stays the same
+    std::pair<int, int> stack[max_min_weight_vertices];
+    int stack_size = 0;
+    stack[stack_size++] = {0, n-1};
+    while (stack_size) {
+        auto [i, j] = stack[--stack_size];
+        if (j - i < 2)
+            continue;
+        int k = split[i][j];
+        *out++ = triangle_t{i, k, j};
+        stack[stack_size++] = {i, k};
+        stack[stack_size++] = {k, j};
+    }
+    return out;
+}
+
+static constexpr int vertex_cache_size = 32;
+
+// tom forsyth, linear-speed vertex cache optimisation
+static float vertex_score(int cache_position, uint32_t remaining) {
+    if (remaining == 0)
+        return -1.0f;
+    float score = 0.0f;
+    if (cache_position >= 0) {
+        if (cache_position < 3)
+            score = 0.75f; // the last triangle's vertices
+        else
+            score = powf(1.0f - float(cache_position - 3) / float(vertex_cache_size - 3), 1.5f);
+    }
+    // favour vertices with few triangles left, to finish them off
+    return score + 2.0f / sqrtf(float(remaining));
+}
+
+// greedily emits the triangle with the best score among those using a
+// vertex in the simulated cache, or the next one in the old order when none
+// do. afterwards the vertices are renumbered in order of first use
+static void reorder_for_vertex_cache(mesh_group_t& group) {
+    size_t vertex_count = group.vertices.size();
+    size_t triangle_count = group.indices.size() / 3;
+    const vector_t<uint32_t>& indices = group.indices;
+
+    // live triangles of each vertex, remaining[v] of them from first[v]
+    vector_t<uint32_t> remaining(vertex_count, 0);
+    vector_t<uint32_t> first(vertex_count + 1, 0);
+    vector_t<uint32_t> vertex_triangles(indices.size());
+    for (uint32_t index: indices)
+        ++remaining[index];
+    for (size_t v=0; v<vertex_count; ++v)
+        first[v+1] = first[v] + remaining[v];
+    {
+        vector_t<uint32_t> fill(first.begin(), first.end() - 1);
+        for (size_t i=0; i<indices.size(); ++i)
+            vertex_triangles[fill[indices[i]]++] = uint32_t(i / 3);
+    }
+
+    vector_t<int> cache_position(vertex_count, -1);
+    vector_t<float> score(vertex_count);
+    for (size_t v=0; v<vertex_count; ++v)
+        score[v] = vertex_score(-1, remaining[v]);
+    vector_t<float> triangle_score(triangle_count);
+    for (size_t t=0; t<triangle_count; ++t)
+        triangle_score[t] = score[indices[t*3]] + score[indices[t*3+1]] + score[indices[t*3+2]];
+    vector_t<bool> emitted(triangle_count, false);
+
+    vector_t<uint32_t> output;
+    output.reserve(indices.size());
+    uint32_t cache[vertex_cache_size + 3];
+    uint32_t new_cache[vertex_cache_size + 3];
+    int cache_size = 0;
+    size_t next_unemitted = 0;
+    long best = -1;
+
+    for (size_t n=0; n<triangle_count; ++n) {
+        if (best < 0) {
+            while (emitted[next_unemitted])
+                ++next_unemitted;
+            best = long(next_unemitted);
+        }
+        emitted[best] = true;
+
+        // new cache: the triangle's vertices, then the rest in lru order
+        int new_cache_size = 0;
+        for (int c=0; c<3; ++c) {
+            uint32_t v = indices[best*3 + c];
+            output.push_back(v);
+            new_cache[new_cache_size++] = v;
+            uint32_t *live = &vertex_triangles[first[v]];
+            uint32_t *found = std::find(live, live + remaining[v], uint32_t(best));
+            if (found == live + remaining[v])
+                continue; // repeated vertex of a degenerate triangle
+            std::swap(*found, live[remaining[v] - 1]);
+            --remaining[v];
+        }
+        for (int c=0; c<cache_size; ++c) {
+            uint32_t v = cache[c];
+            if (v != new_cache[0] && v != new_cache[1] && v != new_cache[2])
+                new_cache[new_cache_size++] = v;
+        }
+
+        // rescore the vertices in the cache, and the ones just pushed out
+        for (int c=0; c<new_cache_size; ++c) {
+            uint32_t v = new_cache[c];
+            cache_position[v] = c < vertex_cache_size? c: -1;
+            score[v] = vertex_score(cache_position[v], remaining[v]);
+        }
+        best = -1;
+        float best_score = -1.0f;
+        for (int c=0; c<new_cache_size; ++c) {
+            uint32_t v = new_cache[c];
+            for (uint32_t i=0; i<remaining[v]; ++i) {
+                uint32_t t = vertex_triangles[first[v] + i];
+                triangle_score[t] = score[indices[t*3]] + score[indices[t*3+1]] + score[indices[t*3+2]];
+                if (triangle_score[t] > best_score) {
+                    best_score = triangle_score[t];
+                    best = long(t);
+                }
+            }
+        }
+
+        cache_size = std::min(new_cache_size, vertex_cache_size);
+        std::copy(new_cache, new_cache + cache_size, cache);
+    }
+
+    vector_t<uint32_t> renumbered(vertex_count, uint32_t(-1));
+    vector_t<mesh_vertex_t> vertices;
+    vertices.reserve(vertex_count);
+    for (uint32_t& index: output) {
+        if (renumbered[index] == uint32_t(-1)) {
+            renumbered[index] = uint32_t(vertices.size());
+            vertices.push_back(group.vertices[index]);
+        }
+        index = renumbered[index];
+    }
+    group.vertices = std::move(vertices);
+    group.indices = std::move(output);
+}
+
+static int find_part(vector_t<mesh_part_t>& parts, const mesh_key_t& key, brush_t *brush) {
+    for (size_t i=0; i<parts.size(); ++i)
+        if (parts[i].key == key)
+            return int(i);
+    parts.push_back(mesh_part_t{key, brush, {}, {}});
+    return int(parts.size()) - 1;
+}
+
+static void make_parts(const mesh_t *mesh, volume_t outside_volume, brush_t *brush,
+                       vector_t<mesh_part_t>& parts)
+{
+    parts.clear();
+    map_t<weld_key_t, uint32_t> welded;
+    vector_t<uint32_t> fragment_indices;
+    vector_t<triangle_t> tris;
+    for (const face_t& face: brush->faces) {
+        welded.clear();
+        for (const fragment_t& fragment: face.fragments) {
+            if (fragment.front_volume == fragment.back_volume)
+                continue;
+
+            bool flip = fragment.back_volume == outside_volume;
+            mesh_key_t key = {brush->uid, 0};
+            if (mesh->grouping == MESH_GROUP_BY_VOLUMES) {
+                key = flip? mesh_key_t{fragment.back_volume, fragment.front_volume}:
+                            mesh_key_t{fragment.front_volume, fragment.back_volume};
+            }
+            int part_index = find_part(parts, key, brush);
+            mesh_part_t& part = parts[part_index];
+            vec3_t normal = flip? -face.plane->normal: face.plane->normal;
+
+            fragment_indices.clear();
+            for (const vertex_t& vertex: fragment.vertices) {
+                const vec3_t& p = vertex.position;
+                auto [it, inserted] = welded.emplace(
+                    weld_key_t{part_index*2 + flip, {p.x, p.y, p.z}},
+                    uint32_t(part.vertices.size()));
+                if (inserted)
+                    part.vertices.push_back(mesh_vertex_t{p, normal});
+                fragment_indices.push_back(it->second);
+            }
+
+            tris.resize(triangle_count(fragment));
+            if (mesh->triangulation == MESH_TRIANGULATE_MIN_WEIGHT)
+                triangulate_min_weight(fragment, tris.data());
+            else
+                triangulate(fragment, tris.data());
+            for (const triangle_t& tri: tris) {
+                part.indices.push_back(fragment_indices[tri.i]);
+                part.indices.push_back(fragment_indices[flip? tri.k: tri.j]);
+                part.indices.push_back(fragment_indices[flip? tri.j: tri.k]);
+            }
+        }
+    }
+}
+
+static mesh_group_t *find_group(vector_t<mesh_group_t>& groups, const mesh_key_t& key) {
+    auto it = std::lower_bound(groups.begin(), groups.end(), key,
+        [](const mesh_group_t& group, const mesh_key_t& key) { return group.key < key; });
+    if (it == groups.end() || it->key != key)
+        return NULL;
+    return &*it;
+}
+
+static const mesh_part_t *find_part(const vector_t<mesh_part_t>& parts, const mesh_key_t& key) {
+    for (const mesh_part_t& part: parts)
+        if (part.key == key)
+            return &part;
+    return NULL;
+}
+
+static void add_group_brushes(mesh_t *mesh, int uid, const vector_t<mesh_part_t>& parts) {
+    for (const mesh_part_t& part: parts)
+        mesh->group_brushes[part.key].insert(uid);
+}
+
+static void remove_group_brushes(mesh_t *mesh, int uid, const vector_t<mesh_part_t>& parts) {
+    for (const mesh_part_t& part: parts) {
+        auto it = mesh->group_brushes.find(part.key);
+        it->second.erase(uid);
+        if (it->second.empty())
+            mesh->group_brushes.erase(it);
+    }
+}
+
+// clears the groups with the given keys (adding the missing ones) and fills
+// them again from the parts of the brushes in them, in uid order
+static void fill_groups(mesh_t *mesh, const set_t<mesh_key_t>& keys) {
+    vector_t<mesh_group_t>& groups = mesh->groups;
+    mesh_grouping_t grouping = mesh->grouping;
+
+    for (const mesh_key_t& key: keys) {
+        mesh_group_t *group = find_group(groups, key);
+        if (!group) {
+            auto it = std::lower_bound(groups.begin(), groups.end(), key,
+                [](const mesh_group_t& group, const mesh_key_t& key) { return group.key < key; });
+            group = &*groups.insert(it, mesh_group_t{});
+            group->key = key;
+            group->front_volume = grouping == MESH_GROUP_BY_VOLUMES? key[0]: 0;
+            group->back_volume  = grouping == MESH_GROUP_BY_VOLUMES? key[1]: 0;
+            group->brush = NULL;
+        }
+        group->vertices.clear();
+        group->indices.clear();
+        group->changed = true;
+    }
+
+    for (const mesh_key_t& key: keys) {
+        auto brushes = mesh->group_brushes.find(key);
+        if (brushes == mesh->group_brushes.end())
+            continue;
+        mesh_group_t *group = find_group(groups, key);
+        for (int uid: brushes->second) {
+            const mesh_part_t *part = find_part(mesh->brush_parts.find(uid)->second, key);
+            uint32_t base = uint32_t(group->vertices.size());
+            group->vertices.insert(group->vertices.end(), part->vertices.begin(), part->vertices.end());
+            for (uint32_t index: part->indices)
+                group->indices.push_back(base + index);
+            if (grouping == MESH_GROUP_BY_BRUSH)
+                group->brush = part->brush;
+        }
+    }
+
+    if (mesh->optimize_vertex_cache) {
+        for (const mesh_key_t& key: keys)
+            reorder_for_vertex_cache(*find_group(groups, key));
+    }
+}
+
+void mesh_t::build(world_t *world) {
+    this->world = world;
+    volume_t outside = has_outside_volume? outside_volume: world->get_void_volume();
+
+    groups.clear();
+    brush_parts.clear();
+    group_brushes.clear();
+    set_t<mesh_key_t> keys;
+    for (brush_t *brush = world->first(); brush; brush = world->next(brush)) {
+        vector_t<mesh_part_t>& parts = brush_parts[brush->uid];
+        make_parts(this, outside, brush, parts);
+        add_group_brushes(this, brush->uid, parts);
+        for (const mesh_part_t& part: parts)
+            keys.insert(part.key);
+    }
+    fill_groups(this, keys);
+}
+
+void mesh_t::update(const vector_t<change_t>& changes) {
+    volume_t outside = has_outside_volume? outside_volume: world->get_void_volume();
+
+    // groups emptied by the last update are gone now
+    groups.erase(std::remove_if(groups.begin(), groups.end(),
+        [](const mesh_group_t& group) { return group.vertices.empty(); }), groups.end());
+    for (mesh_group_t& group: groups)
+        group.changed = false;
+
+    // groups the brush was in before and is in now
+    set_t<mesh_key_t> keys;
+    for (const change_t& change: changes) {
+        if (!(change.kinds & (CHANGE_FACES | CHANGE_FRAGMENTS | CHANGE_REMOVED)))
+            continue;
+        int uid = change.brush->uid;
+        vector_t<mesh_part_t>& parts = brush_parts[uid];
+        for (const mesh_part_t& part: parts)
+            keys.insert(part.key);
+        remove_group_brushes(this, uid, parts);
+        if (change.kinds & CHANGE_REMOVED) {
+            brush_parts.erase(uid);
+            continue;
+        }
+        make_parts(this, outside, change.brush, parts);
+        add_group_brushes(this, uid, parts);
+        for (const mesh_part_t& part: parts)
+            keys.insert(part.key);
+    }
+    fill_groups(this, keys);
+}
+
+const vector_t<mesh_group_t>& mesh_t::get_groups() const {
+    return groups;
+}
+
+size_t mesh_t::get_vertex_count() const {
+    size_t count = 0;
+    for (const mesh_group_t& group: groups)
+        count += group.vertices.size();
+    return count;
+}
+
+size_t mesh_t::get_index_count() const {
+    size_t count = 0;
+    for (const mesh_group_t& group: groups)
+        count += group.indices.size();
+    return count;
+}
+
+void mesh_t::write(mesh_vertex_t *vertices, uint32_t *indices) const {
+    for (const mesh_group_t& group: groups) {
+        vertices = std::copy(group.vertices.begin(), group.vertices.end(), vertices);
+        indices = std::copy(group.indices.begin(), group.indices.end(), indices);
+    }
+}
+
+}
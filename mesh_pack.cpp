@@ -0,0 +1,153 @@
+#include "csg_private.hpp"
+#include <algorithm>
+
+#include <math.h>
+
+namespace csg {
+
+static constexpr uint32_t max_chunk_vertices = 65536;
+static constexpr scalar_t position_scale = 65535;
+static constexpr scalar_t normal_scale = 127;
+
+static scalar_t sign_not_zero(scalar_t x) {
+    return x < 0? scalar_t(-1): scalar_t(1);
+}
+
+// octahedral encoding: project onto the octahedron |x|+|y|+|z| = 1 and fold
+// the lower half over the upper one, leaving x and y
+static void pack_normal(const vec3_t& normal, int8_t packed[2]) {
+    vec3_t n = normal / (glm::abs(normal.x) + glm::abs(normal.y) + glm::abs(normal.z));
+    scalar_t x = n.x, y = n.y;
+    if (n.z < 0) {
+        x = (1 - glm::abs(n.y)) * sign_not_zero(n.x);
+        y = (1 - glm::abs(n.x)) * sign_not_zero(n.y);
+    }
+    packed[0] = int8_t(lround(glm::clamp(x, scalar_t(-1), scalar_t(1)) * normal_scale));
+    packed[1] = int8_t(lround(glm::clamp(y, scalar_t(-1), scalar_t(1)) * normal_scale));
+}
+
+vec3_t unpack_normal(const packed_vertex_t& vertex) {
+    scalar_t x = vertex.normal[0] / normal_scale;
+    scalar_t y = vertex.normal[1] / normal_scale;
+    scalar_t z = 1 - glm::abs(x) - glm::abs(y);
+    if (z < 0) {
+        scalar_t folded_x = (1 - glm::abs(y)) * sign_not_zero(x);
+        scalar_t folded_y = (1 - glm::abs(x)) * sign_not_zero(y);
+        x = folded_x;
+        y = folded_y;
+    }
+    return glm::normalize(vec3_t(x, y, z));
+}
+
+vec3_t unpack_position(const packed_chunk_t& chunk, const packed_vertex_t& vertex) {
+    vec3_t t = vec3_t(vertex.position[0], vertex.position[1], vertex.position[2]) / position_scale;
+    return chunk.box.min + t * (chunk.box.max - chunk.box.min);
+}
+
+// collects the triangles of one chunk, with the group's vertex indices
+// mapped to the chunk's own
+struct chunk_builder_t {
+    const mesh_group_t     *group;
+    vector_t<uint32_t>     local;      // per group vertex, or -1
+    vector_t<uint32_t>     vertices;   // group vertex per chunk vertex
+    vector_t<uint16_t>     indices;
+};
+
+static uint32_t new_vertex_count(const chunk_builder_t& chunk, const uint32_t *triangle) {
+    uint32_t count = 0;
+    for (int c=0; c<3; ++c)
+        if (chunk.local[triangle[c]] == uint32_t(-1))
+            ++count;
+    return count;
+}
+
+static void add_triangle(chunk_builder_t& chunk, const uint32_t *triangle) {
+    for (int c=0; c<3; ++c) {
+        uint32_t& local = chunk.local[triangle[c]];
+        if (local == uint32_t(-1)) {
+            local = uint32_t(chunk.vertices.size());
+            chunk.vertices.push_back(triangle[c]);
+        }
+        chunk.indices.push_back(uint16_t(local));
+    }
+}
+
+static void finish_chunk(chunk_builder_t& chunk, int group_index, packed_mesh_t& packed) {
+    if (chunk.indices.empty())
+        return;
+
+    packed_chunk_t packed_chunk;
+    packed_chunk.group = group_index;
+    packed_chunk.first_vertex = uint32_t(packed.vertices.size());
+    packed_chunk.vertex_count = uint32_t(chunk.vertices.size());
+    packed_chunk.first_index = uint32_t(packed.indices.size());
+    packed_chunk.index_count = uint32_t(chunk.indices.size());
+
+    box_t& box = packed_chunk.box;
+    box.min = box.max = chunk.group->vertices[chunk.vertices[0]].position;
+    for (uint32_t v: chunk.vertices) {
+        box.min = glm::min(box.min, chunk.group->vertices[v].position);
+        box.max = glm::max(box.max, chunk.group->vertices[v].position);
+    }
+    vec3_t extent = box.max - box.min;
+
+    for (uint32_t v: chunk.vertices) {
+        const mesh_vertex_t& vertex = chunk.group->vertices[v];
+        packed_vertex_t packed_vertex;
+        for (int axis=0; axis<3; ++axis) {
+            scalar_t t = extent[axis] > 0? (vertex.position[axis] - box.min[axis]) / extent[axis]: 0;
+            packed_vertex.position[axis] = uint16_t(lround(glm::clamp(t, scalar_t(0), scalar_t(1)) * position_scale));
+        }
+        pack_normal(vertex.normal, packed_vertex.normal);
+        packed.vertices.push_back(packed_vertex);
+        chunk.local[v] = uint32_t(-1);
+    }
+    packed.indices.insert(packed.indices.end(), chunk.indices.begin(), chunk.indices.end());
+    packed.chunks.push_back(packed_chunk);
+
+    chunk.vertices.clear();
+    chunk.indices.clear();
+}
+
+void mesh_t::pack(packed_mesh_t& packed, scalar_t chunk_size) const {
+    packed.vertices.clear();
+    packed.indices.clear();
+    packed.chunks.clear();
+
+    chunk_builder_t chunk;
+    vector_t<uint32_t> order;
+    vector_t<std::array<int, 3>> cells;
+    for (size_t g=0; g<groups.size(); ++g) {
+        const mesh_group_t& group = groups[g];
+        uint32_t triangle_count = uint32_t(group.indices.size() / 3);
+        chunk.group = &group;
+        chunk.local.assign(group.vertices.size(), uint32_t(-1));
+
+        // group the triangles by grid cell, keeping their order otherwise
+        order.resize(triangle_count);
+        for (uint32_t t=0; t<triangle_count; ++t)
+            order[t] = t;
+        cells.clear();
+        if (chunk_size > 0) {
+            cells.resize(triangle_count);
+            for (uint32_t t=0; t<triangle_count; ++t) {
+                vec3_t cell = glm::floor(group.vertices[group.indices[t*3]].position / chunk_size);
+                cells[t] = {int(cell.x), int(cell.y), int(cell.z)};
+            }
+            std::stable_sort(order.begin(), order.end(),
+                [&](uint32_t a, uint32_t b) { return cells[a] < cells[b]; });
+        }
+
+        for (uint32_t i=0; i<triangle_count; ++i) {
+            uint32_t t = order[i];
+            const uint32_t *triangle = &group.indices[t*3];
+            bool new_cell = chunk_size > 0 && i > 0 && cells[t] != cells[order[i-1]];
+            if (new_cell || chunk.vertices.size() + new_vertex_count(chunk, triangle) > max_chunk_vertices)
+                finish_chunk(chunk, int(g), packed);
+            add_triangle(chunk, triangle);
+        }
+        finish_chunk(chunk, int(g), packed);
+    }
+}
+
+}
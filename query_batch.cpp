@@ -0,0 +1,318 @@
+#include "csg_private.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+namespace csg {
+
+// queries per chunk, a chunk of point and box queries tests the brushes
+// near all of them once before testing each query against those
+static constexpr int box_chunk_queries = 64;
+static constexpr int ray_chunk_queries = 16;
+
+static bool box_intersects_box(const box_t& box, const box_t& other_box) {
+    return glm::all(glm::lessThanEqual(box.min, other_box.max)) &&
+           glm::all(glm::greaterThanEqual(box.max, other_box.min));
+}
+
+// spreads the lowest 10 bits of x over every third bit
+static uint32_t spread_bits(uint32_t x) {
+    x &= 0x3ff;
+    x = (x | (x << 16)) & 0x030000ff;
+    x = (x | (x << 8)) & 0x0300f00f;
+    x = (x | (x << 4)) & 0x030c30c3;
+    x = (x | (x << 2)) & 0x09249249;
+    return x;
+}
+
+uint32_t morton_code(const vec3_t& point, const box_t& bounds) {
+    vec3_t size = glm::max(bounds.max - bounds.min, vec3_t(scalar_t(1e-6)));
+    vec3_t cell = glm::clamp((point - bounds.min) / size * scalar_t(1023), vec3_t(0), vec3_t(1023));
+    return spread_bits(uint32_t(cell.x)) |
+           (spread_bits(uint32_t(cell.y)) << 1) |
+           (spread_bits(uint32_t(cell.z)) << 2);
+}
+
+// threads kept waiting between runs, each run wakes them all up to pull
+// chunks next to the thread calling run
+struct query_batch_t::workers_t {
+    csg_replace_new_delete
+    vector_t<std::thread>   threads;
+    std::mutex              mutex;
+    std::condition_variable start;   // a new run or stop
+    std::condition_variable done;    // the last worker finished the run
+    std::function<void()>   job;     // what every worker does in this run
+    uint64_t                run = 0; // counts runs, so workers see new ones
+    int                     busy = 0;
+    bool                    stop = false;
+
+    // last_run is the run before the thread was started
+    void work(uint64_t last_run) {
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                start.wait(lock, [&]() { return stop || run != last_run; });
+                if (stop)
+                    return;
+                last_run = run;
+            }
+            job();
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busy == 0)
+                done.notify_one();
+        }
+    }
+
+    void join() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        start.notify_all();
+        for (std::thread& thread: threads)
+            thread.join();
+        threads.clear();
+        stop = false;
+    }
+};
+
+query_batch_t::query_batch_t() {
+    thread_count = 0;
+}
+
+query_batch_t::~query_batch_t() {
+    if (workers)
+        workers->join();
+}
+
+void query_batch_t::set_thread_count(int thread_count) {
+    if (workers && thread_count != this->thread_count)
+        workers->join();
+    this->thread_count = thread_count;
+}
+
+int query_batch_t::add_point(const vec3_t& point) {
+    int query = add_box(box_t{ point, point });
+    queries[query].type = QUERY_POINT;
+    return query;
+}
+
+int query_batch_t::add_box(const box_t& box) {
+    query_t query;
+    query.type = QUERY_BOX;
+    query.box = box;
+    query.frustum = -1;
+    queries.push_back(query);
+    return size() - 1;
+}
+
+int query_batch_t::add_ray(const ray_t& ray) {
+    query_t query;
+    query.type = QUERY_RAY;
+    query.ray = ray;
+    query.frustum = -1;
+    queries.push_back(query);
+    return size() - 1;
+}
+
+int query_batch_t::add_frustum(const mat4_t& view_projection) {
+    query_t query;
+    query.type = QUERY_FRUSTUM;
+    query.frustum = frustums.size();
+    queries.push_back(query);
+    frustums.push_back(view_projection);
+    return size() - 1;
+}
+
+void query_batch_t::clear() {
+    queries.clear();
+    frustums.clear();
+    order.clear();
+    offsets.clear();
+    brushes.clear();
+    hit_offsets.clear();
+    hits.clear();
+}
+
+int query_batch_t::size() const {
+    return queries.size();
+}
+
+query_type_t query_batch_t::get_type(int query) const {
+    return queries[query].type;
+}
+
+const vector_t<int>& query_batch_t::get_offsets() const {
+    return offsets;
+}
+
+const vector_t<brush_t*>& query_batch_t::get_brushes() const {
+    return brushes;
+}
+
+const vector_t<int>& query_batch_t::get_hit_offsets() const {
+    return hit_offsets;
+}
+
+const vector_t<ray_hit_t>& query_batch_t::get_hits() const {
+    return hits;
+}
+
+static void sort_queries(query_batch_t *batch) {
+    // point and box queries go first, by the z-order of their centers
+    // within the bounds of all centers, rays and frustums follow as added
+    auto& queries = batch->queries;
+    auto& order = batch->order;
+    order.clear();
+    box_t bounds{ vec3_t(std::numeric_limits<scalar_t>::max()), vec3_t(std::numeric_limits<scalar_t>::lowest()) };
+    for (int i=0; i<int(queries.size()); ++i) {
+        if (queries[i].type == QUERY_POINT || queries[i].type == QUERY_BOX) {
+            vec3_t center = (queries[i].box.min + queries[i].box.max) * scalar_t(0.5);
+            bounds.min = glm::min(bounds.min, center);
+            bounds.max = glm::max(bounds.max, center);
+            order.push_back(i);
+        }
+    }
+    vector_t<std::pair<uint32_t, int>> keys(order.size());
+    for (size_t i=0; i<order.size(); ++i) {
+        const box_t& box = queries[order[i]].box;
+        keys[i] = { morton_code((box.min + box.max) * scalar_t(0.5), bounds), order[i] };
+    }
+    std::sort(keys.begin(), keys.end());
+    for (size_t i=0; i<keys.size(); ++i)
+        order[i] = keys[i].second;
+    int box_queries = order.size();
+    for (int i=0; i<int(queries.size()); ++i) {
+        if (queries[i].type == QUERY_RAY || queries[i].type == QUERY_FRUSTUM)
+            order.push_back(i);
+    }
+
+    auto& chunks = batch->chunks;
+    size_t chunk_count = 0;
+    auto add_chunks = [&](int first, int last, int chunk_queries) {
+        for (int i=first; i<last; i+=chunk_queries) {
+            if (chunks.size() <= chunk_count)
+                chunks.emplace_back();
+            chunks[chunk_count].first = i;
+            chunks[chunk_count].last = std::min(i + chunk_queries, last);
+            ++chunk_count;
+        }
+    };
+    add_chunks(0, box_queries, box_chunk_queries);
+    add_chunks(box_queries, order.size(), ray_chunk_queries);
+    chunks.resize(chunk_count);
+}
+
+void query_batch_t::run(const world_t *world) {
+    sort_queries(this);
+
+    // the world's brushes in its order, with their boxes next to each other
+    vector_t<brush_t*> world_brushes;
+    vector_t<box_t> boxes;
+    for (brush_t *b = world->sentinel->next; b != world->sentinel; b = b->next) {
+        world_brushes.push_back(b);
+        boxes.push_back(b->box);
+    }
+
+    offsets.assign(queries.size() + 1, 0);
+    hit_offsets.assign(queries.size() + 1, 0);
+    std::atomic<size_t> next_chunk{0};
+    auto run_chunks = [&]() {
+        vector_t<int> candidates;
+        vector_t<brush_t*> found;
+        vector_t<ray_hit_t> found_hits;
+        for (size_t c = next_chunk++; c < chunks.size(); c = next_chunk++) {
+            chunk_t& chunk = chunks[c];
+            chunk.brushes.clear();
+            chunk.hits.clear();
+            const query_t& first = queries[order[chunk.first]];
+            if (first.type == QUERY_POINT || first.type == QUERY_BOX) {
+                box_t bounds = first.box;
+                for (int i=chunk.first+1; i<chunk.last; ++i) {
+                    bounds.min = glm::min(bounds.min, queries[order[i]].box.min);
+                    bounds.max = glm::max(bounds.max, queries[order[i]].box.max);
+                }
+                candidates.clear();
+                for (int k=0; k<int(boxes.size()); ++k) {
+                    if (box_intersects_box(boxes[k], bounds))
+                        candidates.push_back(k);
+                }
+                for (int i=chunk.first; i<chunk.last; ++i) {
+                    const box_t& box = queries[order[i]].box;
+                    size_t start = chunk.brushes.size();
+                    for (int k: candidates) {
+                        if (box_intersects_box(boxes[k], box))
+                            chunk.brushes.push_back(world_brushes[k]);
+                    }
+                    offsets[order[i] + 1] = chunk.brushes.size() - start;
+                }
+                continue;
+            }
+            for (int i=chunk.first; i<chunk.last; ++i) {
+                const query_t& query = queries[order[i]];
+                if (query.type == QUERY_RAY) {
+                    world->query_ray(query.ray, found_hits);
+                    chunk.hits.insert(chunk.hits.end(), found_hits.begin(), found_hits.end());
+                    hit_offsets[order[i] + 1] = found_hits.size();
+                }
+                else {
+                    world->query_frustum(frustums[query.frustum], found);
+                    chunk.brushes.insert(chunk.brushes.end(), found.begin(), found.end());
+                    offsets[order[i] + 1] = found.size();
+                }
+            }
+        }
+    };
+
+    // the calling thread works too, so it needs one worker less. a batch
+    // of one chunk doesn't wake them
+    size_t threads_wanted = thread_count > 0? thread_count:
+        std::max(1u, std::thread::hardware_concurrency());
+    if (threads_wanted > 1 && chunks.size() > 1) {
+        if (!workers)
+            workers.reset(new workers_t);
+        while (workers->threads.size() < threads_wanted - 1)
+            workers->threads.emplace_back(&workers_t::work, workers.get(), workers->run);
+        {
+            std::lock_guard<std::mutex> lock(workers->mutex);
+            workers->job = run_chunks;
+            workers->busy = workers->threads.size();
+            workers->run += 1;
+        }
+        workers->start.notify_all();
+        run_chunks();
+        std::unique_lock<std::mutex> lock(workers->mutex);
+        workers->done.wait(lock, [&]() { return workers->busy == 0; });
+        workers->job = nullptr;
+    }
+    else {
+        run_chunks();
+    }
+
+    // the counts become offsets, then each chunk's results move to the
+    // ranges of its queries
+    for (size_t i=0; i<queries.size(); ++i) {
+        offsets[i + 1] += offsets[i];
+        hit_offsets[i + 1] += hit_offsets[i];
+    }
+    brushes.resize(offsets.back());
+    hits.resize(hit_offsets.back());
+    for (const chunk_t& chunk: chunks) {
+        auto from_brush = chunk.brushes.begin();
+        auto from_hit = chunk.hits.begin();
+        for (int i=chunk.first; i<chunk.last; ++i) {
+            int query = order[i];
+            int count = offsets[query + 1] - offsets[query];
+            std::copy(from_brush, from_brush + count, brushes.begin() + offsets[query]);
+            from_brush += count;
+            int hit_count = hit_offsets[query + 1] - hit_offsets[query];
+            std::copy(from_hit, from_hit + hit_count, hits.begin() + hit_offsets[query]);
+            from_hit += hit_count;
+        }
+    }
+}
+
+}
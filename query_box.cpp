@@ -7,14 +7,31 @@ static bool box_intersects_box(const box_t& box, const box_t& other_box) {
            glm::all(glm::greaterThanEqual(box.max, other_box.min));
 }
 
-vector_t<brush_t*> world_t::query_box(const box_t& box) {
-    vector_t<brush_t*> result;
-    brush_t *b = first();
-    while (b) {
+void world_t::query_box(const box_t& box, vector_t<brush_t*>& result) const {
+    result.clear();
+    for (brush_t *b = sentinel->next; b != sentinel; b = b->next) {
         if (box_intersects_box(b->box, box))
             result.push_back(b);
-        b = next(b);
     }
+}
+
+vector_t<brush_t*> world_t::query_box(const box_t& box) const {
+    vector_t<brush_t*> result;
+    query_box(box, result);
+    return result;
+}
+
+void world_version_t::query_box(const box_t& box, vector_t<const brush_version_t*>& result) const {
+    result.clear();
+    for (const auto& brush: brushes) {
+        if (box_intersects_box(brush->box, box))
+            result.push_back(brush.get());
+    }
+}
+
+vector_t<const brush_version_t*> world_version_t::query_box(const box_t& box) const {
+    vector_t<const brush_version_t*> result;
+    query_box(box, result);
     return result;
 }
 
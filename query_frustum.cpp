@@ -4,7 +4,7 @@
 
 namespace csg {
 
-static float signed_distance(const glm::vec3& point, const plane_t& plane) {
+static scalar_t signed_distance(const vec3_t& point, const plane_t& plane) {
     return glm::dot(plane.normal, point) + plane.offset;
 }
 
@@ -24,8 +24,8 @@ static constexpr box_corner_t right_bottom_far  = 0b101;
 static constexpr box_corner_t left_top_far      = 0b110;
 static constexpr box_corner_t right_top_far     = 0b111;
 
-static glm::vec3 box_corner(box_t box, box_corner_t corner) {
-    return glm::vec3(
+static vec3_t box_corner(box_t box, box_corner_t corner) {
+    return vec3_t(
         is_bit_set(corner, 0)? box.max.x: box.min.x,
         is_bit_set(corner, 1)? box.max.y: box.min.y,
         is_bit_set(corner, 2)? box.max.z: box.min.z
@@ -35,8 +35,8 @@ static glm::vec3 box_corner(box_t box, box_corner_t corner) {
 // the box corner with the smallest signed distance to the plane
 // (always the same corner with every box)
 static box_corner_t min_box_corner(const plane_t& plane) {
-    box_t box{glm::vec3(0,0,0), glm::vec3(1,1,1)}; 
-    std::pair<float, box_corner_t> distance_corner_pairs[8];
+    box_t box{vec3_t(0,0,0), vec3_t(1,1,1)}; 
+    std::pair<scalar_t, box_corner_t> distance_corner_pairs[8];
     for (box_corner_t i=0; i<8; ++i) 
         distance_corner_pairs[i] = {
             signed_distance(box_corner(box, i), plane),
@@ -55,7 +55,7 @@ struct frustum_t {
 };
 
 static frustum_t make_frustum_from_matrix(
-    const glm::mat4& view_projection)
+    const mat4_t& view_projection)
 {
     // https://gdbooks.gitbooks.io/legacyopengl/content/Chapter8/frustum.html
     // The plane values can be found by adding or subtracting one of the 
@@ -66,20 +66,20 @@ static frustum_t make_frustum_from_matrix(
     // Top Plane Row 1 Negated (subtraction)
     // Near Plane Row 2 (addition)
     // Far Plane Row 2 Negated (subtraction)
-    glm::vec4 l = glm::row(view_projection, 3) + glm::row(view_projection, 0); 
-    glm::vec4 r = glm::row(view_projection, 3) - glm::row(view_projection, 0); 
-    glm::vec4 b = glm::row(view_projection, 3) + glm::row(view_projection, 1); 
-    glm::vec4 t = glm::row(view_projection, 3) - glm::row(view_projection, 1); 
-    glm::vec4 n = glm::row(view_projection, 3) + glm::row(view_projection, 2); 
-    glm::vec4 f = glm::row(view_projection, 3) - glm::row(view_projection, 2); 
+    vec4_t l = glm::row(view_projection, 3) + glm::row(view_projection, 0); 
+    vec4_t r = glm::row(view_projection, 3) - glm::row(view_projection, 0); 
+    vec4_t b = glm::row(view_projection, 3) + glm::row(view_projection, 1); 
+    vec4_t t = glm::row(view_projection, 3) - glm::row(view_projection, 1); 
+    vec4_t n = glm::row(view_projection, 3) + glm::row(view_projection, 2); 
+    vec4_t f = glm::row(view_projection, 3) - glm::row(view_projection, 2); 
     // we need to negate because the above source has normals pointing *inside*
     // the frustum
-    plane_t left  {-glm::vec3(l), -l.w};
-    plane_t right {-glm::vec3(r), -r.w};
-    plane_t bottom{-glm::vec3(b), -b.w};
-    plane_t top   {-glm::vec3(t), -t.w};
-    plane_t near  {-glm::vec3(n), -n.w};
-    plane_t far   {-glm::vec3(f), -f.w};
+    plane_t left  {-vec3_t(l), -l.w};
+    plane_t right {-vec3_t(r), -r.w};
+    plane_t bottom{-vec3_t(b), -b.w};
+    plane_t top   {-vec3_t(t), -t.w};
+    plane_t near  {-vec3_t(n), -n.w};
+    plane_t far   {-vec3_t(f), -f.w};
     return frustum_t{
         { left, right, bottom, top, near, far },
         {
@@ -96,13 +96,13 @@ static frustum_t make_frustum_from_matrix(
 // inexact-- returns false positives, but good for frustum culling
 bool frustum_intersects_box(const frustum_t& frustum, const box_t& box) {
     for (int i=0; i<6; ++i) {
-        glm::vec3 min_corner = box_corner(box, frustum.min_box_corners[i]);
+        vec3_t min_corner = box_corner(box, frustum.min_box_corners[i]);
         if (signed_distance(min_corner, frustum.planes[i]) > 0.0f)
             return false;
     }
     return true;
    /*
-    glm::vec3 center = (box.max + box.min) / 2.0f;
+    vec3_t center = (box.max + box.min) / scalar_t(2);
 
     for (int i=0; i<6; ++i) {
         if (signed_distance(center, frustum.planes[i]) > 0.0f)
@@ -112,18 +112,47 @@ bool frustum_intersects_box(const frustum_t& frustum, const box_t& box) {
     */
 }
 
-vector_t<brush_t*> world_t::query_frustum(
-    const glm::mat4& view_projection
-)
+void world_t::query_frustum(
+    const mat4_t& view_projection,
+    vector_t<brush_t*>& result
+) const
 {
     frustum_t frustum = make_frustum_from_matrix(view_projection);
-    vector_t<brush_t*> result;
-    brush_t *b = first();
-    while (b) {
+    result.clear();
+    for (brush_t *b = sentinel->next; b != sentinel; b = b->next) {
         if (frustum_intersects_box(frustum, b->box))
             result.push_back(b);
-        b = next(b);
     }
+}
+
+vector_t<brush_t*> world_t::query_frustum(
+    const mat4_t& view_projection
+) const
+{
+    vector_t<brush_t*> result;
+    query_frustum(view_projection, result);
+    return result;
+}
+
+void world_version_t::query_frustum(
+    const mat4_t& view_projection,
+    vector_t<const brush_version_t*>& result
+) const
+{
+    frustum_t frustum = make_frustum_from_matrix(view_projection);
+    result.clear();
+    for (const auto& brush: brushes) {
+        if (frustum_intersects_box(frustum, brush->box))
+            result.push_back(brush.get());
+    }
+}
+
+vector_t<const brush_version_t*> world_version_t::query_frustum(
+    const mat4_t& view_projection
+) const
+{
+    vector_t<const brush_version_t*> result;
+    query_frustum(view_projection, result);
     return result;
 }
 
@@ -7,18 +7,35 @@ static bool box_intersects_box(const box_t& box, const box_t& other_box) {
            glm::all(glm::greaterThanEqual(box.max, other_box.min));
 }
 
-static bool box_contains_point(const box_t& box, const glm::vec3& point) {
+static bool box_contains_point(const box_t& box, const vec3_t& point) {
     return box_intersects_box(box, box_t{point, point});
 }
 
-vector_t<brush_t*> world_t::query_point(const glm::vec3& point) {
-    vector_t<brush_t*> result;
-    brush_t *b = first();
-    while (b) {
+void world_t::query_point(const vec3_t& point, vector_t<brush_t*>& result) const {
+    result.clear();
+    for (brush_t *b = sentinel->next; b != sentinel; b = b->next) {
         if (box_contains_point(b->box, point))
             result.push_back(b);
-        b = next(b);
     }
+}
+
+vector_t<brush_t*> world_t::query_point(const vec3_t& point) const {
+    vector_t<brush_t*> result;
+    query_point(point, result);
+    return result;
+}
+
+void world_version_t::query_point(const vec3_t& point, vector_t<const brush_version_t*>& result) const {
+    result.clear();
+    for (const auto& brush: brushes) {
+        if (box_contains_point(brush->box, point))
+            result.push_back(brush.get());
+    }
+}
+
+vector_t<const brush_version_t*> world_version_t::query_point(const vec3_t& point) const {
+    vector_t<const brush_version_t*> result;
+    query_point(point, result);
     return result;
 }
 
@@ -4,28 +4,28 @@
 
 namespace csg {
 
-static float signed_distance(const glm::vec3& point, const plane_t& plane) {
+static scalar_t signed_distance(const vec3_t& point, const plane_t& plane) {
     return glm::dot(plane.normal, point) + plane.offset;
 }
 
-static glm::vec3 projection_of_point_onto_plane(const glm::vec3& point,
-                                                const plane_t& plane)
+static vec3_t projection_of_point_onto_plane(const vec3_t& point,
+                                             const plane_t& plane)
 {
     return point - signed_distance(point, plane) * plane.normal;
 }
 
 static bool ray_intersects_box(const ray_t& ray,
                                const box_t& box,
-                               const glm::vec3& one_over_ray_direction)
+                               const vec3_t& one_over_ray_direction)
 {
     // branchless slab method 
     // https://tavianator.com/2015/ray_box_nan.html
 
-    float t1 = (box.min[0] - ray.origin[0])*one_over_ray_direction[0];
-    float t2 = (box.max[0] - ray.origin[0])*one_over_ray_direction[0];
+    scalar_t t1 = (box.min[0] - ray.origin[0])*one_over_ray_direction[0];
+    scalar_t t2 = (box.max[0] - ray.origin[0])*one_over_ray_direction[0];
 
-    float tmin = glm::min(t1, t2);
-    float tmax = glm::max(t1, t2);
+    scalar_t tmin = glm::min(t1, t2);
+    scalar_t tmax = glm::max(t1, t2);
 
     for (int i = 1; i < 3; ++i) {
         t1 = (box.min[i] - ray.origin[i])*one_over_ray_direction[i];
@@ -35,43 +35,43 @@ static bool ray_intersects_box(const ray_t& ray,
         tmax = glm::min(tmax, glm::max(t1, t2));
     }
 
-    return tmax > glm::max(tmin, 0.0f);      
+    return tmax > glm::max(tmin, scalar_t(0));      
 }
 
 static bool ray_intersects_plane(const ray_t& ray,
                                  const plane_t& plane,
-                                 float& t)
+                                 scalar_t& t)
 {
     return glm::intersectRayPlane(
         ray.origin,
         ray.direction,
-        projection_of_point_onto_plane(glm::vec3(0,0,0), plane),
+        projection_of_point_onto_plane(vec3_t(0,0,0), plane),
         plane.normal,
         t
     );
 }
 
-static bool point_inside_convex_polygon(const glm::vec3& point,
+static bool point_inside_convex_polygon(const vec3_t& point,
                                         const vector_t<vertex_t>& vertices)
 {
     int n = vertices.size();
     if (n < 3) 
         return false;
 
-    glm::vec3 v0 = vertices[0].position;
-    glm::vec3 v1 = vertices[1].position;
-    glm::vec3 v2 = vertices[2].position;
-    glm::vec3 normal = glm::cross(v1-v0, v2-v0);
+    vec3_t v0 = vertices[0].position;
+    vec3_t v1 = vertices[1].position;
+    vec3_t v2 = vertices[2].position;
+    vec3_t normal = glm::cross(v1-v0, v2-v0);
 
     for (int i=0; i<n; ++i) {
         int j = (i+1) % n;
         
-        glm::vec3 vi = vertices[i].position;
-        glm::vec3 vj = vertices[j].position;
+        vec3_t vi = vertices[i].position;
+        vec3_t vj = vertices[j].position;
 
         // if (glm::dot(normal, glm::cross(vj-vi, point-vi)) < 0.0f)
         
-        static constexpr float epsilon = 0.001f;
+        static constexpr scalar_t epsilon = 0.001;
         if (glm::dot(normal, glm::cross(vj-vi, point-vi)) < -epsilon)
             return false;
     }
@@ -79,44 +79,76 @@ static bool point_inside_convex_polygon(const glm::vec3& point,
     return true;
 }
 
-vector_t<ray_hit_t> world_t::query_ray(const ray_t& ray) {
-    glm::vec3 one_over_ray_direction = 1.0f / ray.direction;
-
-    vector_t<ray_hit_t> result;
-    brush_t *b = first();
-    while (b) {
-        if (ray_intersects_box(ray, b->box, one_over_ray_direction)) {
-            for (size_t iplane=0; iplane<b->planes.size(); ++iplane) {
-                float t;
-                if (ray_intersects_plane(ray, b->planes[iplane], t)) {
-                    glm::vec3 intersection = ray.origin + t * ray.direction;
-                    face_t& face = b->faces[iplane];
+// appends the hits with the fragments of one brush, for brush_t and
+// brush_version_t
+template<class brush_pointer_t, class hit_t>
+static void add_ray_hits(const ray_t& ray,
+                         const vec3_t& one_over_ray_direction,
+                         brush_pointer_t b,
+                         vector_t<hit_t>& result)
+{
+    if (!ray_intersects_box(ray, b->box, one_over_ray_direction))
+        return;
+    for (size_t iplane=0; iplane<b->planes.size(); ++iplane) {
+        scalar_t t;
+        if (ray_intersects_plane(ray, b->planes[iplane], t)) {
+            vec3_t intersection = ray.origin + t * ray.direction;
+            auto& face = b->faces[iplane];
+            if (point_inside_convex_polygon(intersection,
+                                            face.vertices)) {
+                for (auto& fragment: face.fragments) {
                     if (point_inside_convex_polygon(intersection,
                                                     face.vertices)) {
-                        for (fragment_t& fragment: face.fragments) {
-                            if (point_inside_convex_polygon(intersection,
-                                                            face.vertices)) {
-                                ray_hit_t ray_hit;
-                                ray_hit.brush = b;
-                                ray_hit.face = &face;
-                                ray_hit.fragment = &fragment;
-                                ray_hit.parameter = t;
-                                ray_hit.position = intersection;
-                                result.push_back(ray_hit);
-                            }
-                        }
+                        hit_t ray_hit;
+                        ray_hit.brush = b;
+                        ray_hit.face = &face;
+                        ray_hit.fragment = &fragment;
+                        ray_hit.parameter = t;
+                        ray_hit.position = intersection;
+                        result.push_back(ray_hit);
                     }
                 }
             }
         }
-        b = next(b);
     }
+}
 
+template<class hit_t>
+static void sort_ray_hits(vector_t<hit_t>& result) {
     std::sort(result.begin(), result.end(),
-        [](const ray_hit_t& hit0, const ray_hit_t& hit1) {
+        [](const hit_t& hit0, const hit_t& hit1) {
             return hit0.parameter < hit1.parameter;
         }
     );
+}
+
+void world_t::query_ray(const ray_t& ray, vector_t<ray_hit_t>& result) const {
+    vec3_t one_over_ray_direction = scalar_t(1) / ray.direction;
+
+    result.clear();
+    for (brush_t *b = sentinel->next; b != sentinel; b = b->next)
+        add_ray_hits(ray, one_over_ray_direction, b, result);
+    sort_ray_hits(result);
+}
+
+vector_t<ray_hit_t> world_t::query_ray(const ray_t& ray) const {
+    vector_t<ray_hit_t> result;
+    query_ray(ray, result);
+    return result;
+}
+
+void world_version_t::query_ray(const ray_t& ray, vector_t<version_ray_hit_t>& result) const {
+    vec3_t one_over_ray_direction = scalar_t(1) / ray.direction;
+
+    result.clear();
+    for (const auto& brush: brushes)
+        add_ray_hits(ray, one_over_ray_direction, brush.get(), result);
+    sort_ray_hits(result);
+}
+
+vector_t<version_ray_hit_t> world_version_t::query_ray(const ray_t& ray) const {
+    vector_t<version_ray_hit_t> result;
+    query_ray(ray, result);
     return result;
 }
 
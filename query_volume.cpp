@@ -0,0 +1,134 @@
+#include "csg_private.hpp"
+#include <algorithm>
+#include <limits>
+
+namespace csg {
+
+// points per chunk of query_volumes, each chunk only looks at the brushes
+// overlapping the bounds of its points
+static constexpr int volume_chunk_points = 256;
+
+static bool box_intersects_box(const box_t& box, const box_t& other_box) {
+    return glm::all(glm::lessThanEqual(box.min, other_box.max)) &&
+           glm::all(glm::greaterThanEqual(box.max, other_box.min));
+}
+
+static bool box_contains_point(const box_t& box, const vec3_t& point) {
+    return box_intersects_box(box, box_t{point, point});
+}
+
+// brushes whose planes don't enclose anything have no faces and contain
+// no points
+static bool brush_contains_point(const brush_t *brush, const vec3_t& point) {
+    return !brush->faces.empty() &&
+           classify_point(point, brush->plane_soa.data(), brush->planes.size()) != RELATION_OUTSIDE;
+}
+
+// scratch space for query_volumes, per thread so queries stay free of
+// writes to the world
+struct volume_classification_t {
+    vector_t<std::pair<uint32_t, int>> order;  // the points along a z-order curve
+    vector_t<brush_t*>   ordered;  // near the points, in csg order
+    vector_t<brush_t*>   near;     // of ordered, near the current chunk
+    vector_t<int>        indices;  // of the chunk's points in a brush's box
+    vector_t<scalar_t>   x, y, z;
+    vector_t<relation_t> relations;
+    vector_t<uint8_t>    inside;
+};
+
+static thread_local vector_t<brush_t*> containing;
+static thread_local volume_classification_t classification;
+
+volume_t world_t::query_volume(const vec3_t& point) const {
+    containing.clear();
+    for (brush_t *b = sentinel->next; b != sentinel; b = b->next) {
+        if (box_contains_point(b->box, point) && brush_contains_point(b, point))
+            containing.push_back(b);
+    }
+    std::sort(containing.begin(), containing.end(), b0_before_b1);
+    volume_t volume = void_volume;
+    for (brush_t *b: containing)
+        volume = b->volume_operation(volume);
+    return volume;
+}
+
+static box_t bounds_of_points(const vec3_t *points, int count) {
+    box_t bounds{ vec3_t(std::numeric_limits<scalar_t>::max()), vec3_t(std::numeric_limits<scalar_t>::lowest()) };
+    for (int i=0; i<count; ++i) {
+        bounds.min = glm::min(bounds.min, points[i]);
+        bounds.max = glm::max(bounds.max, points[i]);
+    }
+    return bounds;
+}
+
+void world_t::query_volumes(const vec3_t *points, int count, volume_t *volumes) const {
+    /*
+        brush by brush instead of point by point: the points are sorted
+        along a z-order curve and split into chunks. for each brush near a
+        chunk (in csg order), the chunk's points inside its box are
+        gathered into x/y/z arrays and classified against one plane after
+        the other with the vectorized kernels, then the brush's volume
+        operation is applied to the points in front of none of its planes
+    */
+    volume_classification_t& c = classification;
+    box_t bounds = bounds_of_points(points, count);
+    c.order.resize(count);
+    for (int i=0; i<count; ++i) {
+        c.order[i] = { morton_code(points[i], bounds), i };
+        volumes[i] = void_volume;
+    }
+    std::sort(c.order.begin(), c.order.end());
+    c.ordered.clear();
+    for (brush_t *b = sentinel->next; b != sentinel; b = b->next) {
+        if (!b->faces.empty() && box_intersects_box(b->box, bounds))
+            c.ordered.push_back(b);
+    }
+    std::sort(c.ordered.begin(), c.ordered.end(), b0_before_b1);
+
+    for (int first=0; first<count; first+=volume_chunk_points) {
+        int last = std::min(first + volume_chunk_points, count);
+        box_t chunk_bounds = { points[c.order[first].second], points[c.order[first].second] };
+        for (int k=first+1; k<last; ++k) {
+            chunk_bounds.min = glm::min(chunk_bounds.min, points[c.order[k].second]);
+            chunk_bounds.max = glm::max(chunk_bounds.max, points[c.order[k].second]);
+        }
+        c.near.clear();
+        for (brush_t *b: c.ordered) {
+            if (box_intersects_box(b->box, chunk_bounds))
+                c.near.push_back(b);
+        }
+
+        for (brush_t *b: c.near) {
+            c.indices.clear();
+            for (int k=first; k<last; ++k) {
+                if (box_contains_point(b->box, points[c.order[k].second]))
+                    c.indices.push_back(c.order[k].second);
+            }
+            int n = c.indices.size();
+            if (n == 0)
+                continue;
+            c.x.resize(n);
+            c.y.resize(n);
+            c.z.resize(n);
+            c.relations.resize(n);
+            c.inside.assign(n, 1);
+            for (int k=0; k<n; ++k) {
+                const vec3_t& point = points[c.indices[k]];
+                c.x[k] = point.x;
+                c.y[k] = point.y;
+                c.z[k] = point.z;
+            }
+            for (const plane_t& plane: b->planes) {
+                classify_points(plane, c.x.data(), c.y.data(), c.z.data(), n, c.relations.data());
+                for (int k=0; k<n; ++k)
+                    c.inside[k] &= (c.relations[k] != RELATION_FRONT);
+            }
+            for (int k=0; k<n; ++k) {
+                if (c.inside[k])
+                    volumes[c.indices[k]] = b->volume_operation(volumes[c.indices[k]]);
+            }
+        }
+    }
+}
+
+}
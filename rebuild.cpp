@@ -6,65 +6,119 @@
 #include <assert.h>
 // #include <stdio.h>
 
-#include <glm/gtc/matrix_access.hpp>
 // #include <glm/gtx/string_cast.hpp>
 
 namespace csg {
 
-enum relation_t {
-    RELATION_FRONT,
-    RELATION_OUTSIDE = RELATION_FRONT,
-    RELATION_BACK,
-    RELATION_INSIDE = RELATION_BACK,
-    RELATION_ALIGNED,
-    RELATION_REVERSE_ALIGNED,
-    RELATION_SPLIT
-};
-
 struct edge_t {
     csg_replace_new_delete
     face_t *faces[2];
 };
 
-static bool approx_equal(float a, float b) {
+#ifndef CSG_EXACT_PLANES
+static bool approx_equal(intersection_scalar_t a, intersection_scalar_t b) {
     // compare to 3 decimal places
     return int(round(a*1000)) == int(round(b*1000));
 }
-
-static float signed_distance(const glm::vec3& point, const plane_t& plane) {
-    return glm::dot(plane.normal, point) + plane.offset;
+#endif
+
+static uint64_t hash_combine(uint64_t seed, uint64_t value) {
+    // splitmix64 finalizer over the running hash
+    uint64_t x = seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
 }
 
-static box_t extended(const box_t& box, const glm::vec3& point) {
+static box_t extended(const box_t& box, const vec3_t& point) {
     return box_t{
         glm::min(box.min, point),
         glm::max(box.max, point)
     };
 }
 
-// does brush0 come before brush1 in the csg order?
+static bool box_intersects_box(const box_t& box, const box_t& other_box) {
+    return glm::all(glm::lessThanEqual(box.min, other_box.max)) &&
+           glm::all(glm::greaterThanEqual(box.max, other_box.min));
+}
+
 // compare by time and use uid (global incrementing counter) as tie-breaker
-static bool b0_before_b1(brush_t* b0, brush_t* b1) {
+bool b0_before_b1(const brush_t* b0, const brush_t* b1) {
     if (b0->time == b1->time)
         return b0->uid < b1->uid;
     return b0->time < b1->time;
 }
 
-static relation_t test(vertex_t* vertex, face_t* face) {
-    float d = signed_distance(vertex->position, *face->plane);
-    if (approx_equal(d, 0.0f))
+#ifndef CSG_EXACT_PLANES
+// scratch space for classifying all vertices of a fragment in one go
+struct vertex_coordinates_t {
+    vector_t<scalar_t> x, y, z;
+};
+
+static thread_local vertex_coordinates_t coordinates;
+#endif
+
+#ifdef CSG_EXACT_PLANES
+static bool try_get_exact_point(const vertex_t& vertex, exact_point_t& point) {
+    // every vertex is the intersection of (at least) three of its faces'
+    // planes, and vertices are only welded when they are exactly equal, so
+    // any three independent faces give back the exact position
+    for (auto i = vertex.faces.begin(); i != vertex.faces.end(); ++i)
+    for (auto j = std::next(i); j != vertex.faces.end(); ++j)
+    for (auto k = std::next(j); k != vertex.faces.end(); ++k) {
+        if (try_make_exact_point(*(*i)->plane, *(*j)->plane, *(*k)->plane, point))
+            return true;
+    }
+    return false;
+}
+
+static relation_t test_exact(const vertex_t& vertex, face_t* face) {
+    // a vertex lies exactly on the planes it was built from, no need to
+    // evaluate those (or any other face sharing the same plane)
+    for (face_t* own: vertex.faces) {
+        if (own->plane_id == face->plane_id)
+            return RELATION_ALIGNED;
+    }
+    exact_point_t point;
+    if (!try_get_exact_point(vertex, point))
         return RELATION_ALIGNED;
-    else if (d > 0)
-        return RELATION_FRONT;
-    else
-        return RELATION_BACK;    
+    return classify_exact(point, *face->plane);
+}
+#endif
+
+static void classify_vertices(const vector_t<vertex_t>& vertices, face_t* face,
+                              vector_t<relation_t>& relations)
+{
+    int n = vertices.size();
+    relations.resize(n);
+#ifdef CSG_EXACT_PLANES
+    for (int i=0; i<n; ++i)
+        relations[i] = test_exact(vertices[i], face);
+#else
+    coordinates.x.resize(n);
+    coordinates.y.resize(n);
+    coordinates.z.resize(n);
+    for (int i=0; i<n; ++i) {
+        coordinates.x[i] = vertices[i].position.x;
+        coordinates.y[i] = vertices[i].position.y;
+        coordinates.z[i] = vertices[i].position.z;
+    }
+    classify_points(
+        *face->plane,
+        coordinates.x.data(),
+        coordinates.y.data(),
+        coordinates.z.data(),
+        n,
+        relations.data()
+    );
+#endif
 }
 
 static relation_t test(vertex_t* vertex, brush_t* brush) {
-    int n = brush->faces.size();
+#ifdef CSG_EXACT_PLANES
     relation_t rel = RELATION_INSIDE;
-    for (int i=0; i<n; ++i) {
-        switch (test(vertex, &brush->faces[i])) {
+    for (face_t& face: brush->faces) {
+        switch (test_exact(*vertex, &face)) {
             case RELATION_FRONT:
                 return RELATION_OUTSIDE;
             case RELATION_ALIGNED:
@@ -74,21 +128,37 @@ static relation_t test(vertex_t* vertex, brush_t* brush) {
         }
     }
     return rel;
+#else
+    return classify_point(
+        vertex->position,
+        brush->plane_soa.data(),
+        brush->planes.size()
+    );
+#endif
 }
 
-static relation_t test(fragment_t* fragment, face_t* face) {
-    map_t<relation_t, int> count;
-    count[RELATION_INSIDE]  = 0;
-    count[RELATION_ALIGNED] = 0;
-    count[RELATION_OUTSIDE] = 0;
-    for (vertex_t& v: fragment->vertices)
-        count[test(&v, face)] += 1;
+static relation_t test(fragment_t* fragment, face_t* face, vector_t<relation_t>& relations) {
+    // relations gets the relation of each vertex to the face, unless the
+    // fragment lies in the face's plane
+
+    // coplanar faces share a plane id, no need to look at the vertices
+    if (fragment->face->plane_id == face->plane_id) {
+        if (fragment->face->plane_sign != face->plane_sign)
+            return RELATION_REVERSE_ALIGNED;
+        else
+            return RELATION_ALIGNED;
+    }
+
+    classify_vertices(fragment->vertices, face, relations);
+    int count[3] = {0, 0, 0};
+    for (relation_t rel: relations)
+        count[rel] += 1;
     if (count[RELATION_OUTSIDE] > 0 &&
         count[RELATION_INSIDE] > 0)
         return RELATION_SPLIT;
     else if (count[RELATION_OUTSIDE] == 0 &&
              count[RELATION_INSIDE] == 0) {
-        float d = glm::dot(face->plane->normal, fragment->face->plane->normal);
+        scalar_t d = glm::dot(face->plane->normal, fragment->face->plane->normal);
         if (d < 0)
             return RELATION_REVERSE_ALIGNED;
         else
@@ -100,8 +170,15 @@ static relation_t test(fragment_t* fragment, face_t* face) {
         return RELATION_OUTSIDE;    
 }
 
+// boxes are grown by this much before they are checked against each other,
+// to stay on the safe side of the tolerance used when classifying vertices
+static const vec3_t box_margin(0.01);
+
 static void recalculate_intersecting_brushes(brush_t *brush) {
-    brush->intersecting_brushes = brush->world->query_box(brush->box);
+    // moved faces can end up a rounding error short of a face they touch
+    // when built from the planes, the brushes still have to carve each other
+    box_t region{ brush->box.min - box_margin, brush->box.max + box_margin };
+    brush->world->query_box(region, brush->intersecting_brushes);
     std::sort(
         brush->intersecting_brushes.begin(),
         brush->intersecting_brushes.end(),
@@ -134,57 +211,84 @@ static bool try_get_edge(const vertex_t* vertex0, const vertex_t* vertex1, edge_
     }
 }
 
-static bool try_make_vertex(face_t *f0, face_t *f1, face_t *f2, vertex_t& v) {
-    // intersect three planes, use cramer's rule
+#ifndef CSG_EXACT_PLANES
+static int face_index(const brush_t* brush, const face_t* face) {
+    // index of the face in the brush's face array, or -1 if it belongs to
+    // some other brush
+    std::less<const face_t*> less;
+    const face_t* begin = brush->faces.data();
+    const face_t* end = begin + brush->faces.size();
+    if (less(face, begin) || !less(face, end))
+        return -1;
+    return face - begin;
+}
+
+static intersection_vec3_t normal_cross(face_t* f0, face_t* f1, brush_t* b0, brush_t* b1) {
+    // cross product of two face normals, taken from the per plane pair
+    // cache (see rebuild_faces_and_box) if both faces belong to b0 or b1
+    for (brush_t* brush: {b0, b1}) {
+        int i = face_index(brush, f0);
+        int j = face_index(brush, f1);
+        if (i >= 0 && j >= 0)
+            return brush->plane_crosses[i * brush->faces.size() + j];
+    }
+    return glm::cross(
+        intersection_vec3_t(f0->plane->normal),
+        intersection_vec3_t(f1->plane->normal)
+    );
+}
+
+static bool try_make_vertex(const plane_t& p0,
+                            const plane_t& p1,
+                            const plane_t& p2,
+                            const intersection_vec3_t& c01,
+                            const intersection_vec3_t& c12,
+                            const intersection_vec3_t& c20,
+                            vec3_t& position)
+{
+    // intersect three planes given the pairwise cross products of their
+    // normals, all three terms share a single determinant:
+    // x = -(d0 (n1 x n2) + d1 (n2 x n0) + d2 (n0 x n1)) / (n0 . (n1 x n2))
+    // (done in intersection_scalar_t, which may be more precise than scalar_t)
+    using real_t = intersection_scalar_t;
+    real_t D = glm::dot(intersection_vec3_t(p0.normal), c12);
+    if (approx_equal(D, 0))
+        return false;
+    position = vec3_t(
+        -(real_t(p0.offset) * c12 + real_t(p1.offset) * c20 + real_t(p2.offset) * c01) / D
+    );
+    return true;
+}
+#endif
+
+static bool try_make_vertex(face_t *f0, face_t *f1, face_t *f2,
+                            brush_t *b0, brush_t *b1, vertex_t& v)
+{
+#ifdef CSG_EXACT_PLANES
+    // (no cross product cache to look up in b0/b1 here)
+    (void)b0;
+    (void)b1;
+    exact_point_t point;
+    if (!try_make_exact_point(*f0->plane, *f1->plane, *f2->plane, point))
+        return false;
+    v.position = to_vec3(point);
+    return true;
+#else
+    // sort so we get the exact same result for the same three faces no
+    // matter which order they come in
     std::array<face_t*, 3> faces = {f0, f1, f2};
     std::sort(faces.begin(), faces.end());
     f0 = faces[0];
     f1 = faces[1];
     f2 = faces[2];
-    
-    // for (int i=0; i<3; ++i)
-    //     printf("plane %d: %f %f %f %f\n", 
-    //         i,
-    //         faces[i]->plane->normal.x,
-    //         faces[i]->plane->normal.y,
-    //         faces[i]->plane->normal.z,
-    //         faces[i]->plane->offset);
-
-    glm::mat3 m;
-    m = glm::row(m, 0, f0->plane->normal);
-    m = glm::row(m, 1, f1->plane->normal);
-    m = glm::row(m, 2, f2->plane->normal);
-
-    // printf("m = %s\n", glm::to_string(m).c_str());
-    // fflush(stdout);
-
-    float D = glm::determinant(m);
-    // printf("D = %f\n", D); fflush(stdout);
-
-    if (approx_equal(D, 0.0f))
-        return false;
-    glm::mat3 mx(m), my(m), mz(m);
-    glm::vec3 offsets(f0->plane->offset, f1->plane->offset, f2->plane->offset);
-    // printf("offsets = %s\n", glm::to_string(offsets).c_str());
-    // fflush(stdout);
-
-    mx = glm::column(mx, 0, -offsets);
-    my = glm::column(my, 1, -offsets);
-    mz = glm::column(mz, 2, -offsets);
-
-    // printf("mx = %s\n", glm::to_string(mx).c_str());
-    // fflush(stdout);
-    // printf("my = %s\n", glm::to_string(my).c_str());
-    // fflush(stdout);        
-    // printf("mz = %s\n", glm::to_string(mz).c_str());
-    // fflush(stdout);    
-
-    v.position = glm::vec3(
-        glm::determinant(mx) / D,
-        glm::determinant(my) / D,
-        glm::determinant(mz) / D
-    );  
-    return true;
+    return try_make_vertex(
+        *f0->plane, *f1->plane, *f2->plane,
+        normal_cross(f0, f1, b0, b1),
+        normal_cross(f1, f2, b0, b1),
+        normal_cross(f2, f0, b0, b1),
+        v.position
+    );
+#endif
 }
 
 static void order_vertices(face_t* face) {
@@ -210,36 +314,84 @@ static void fix_winding(face_t* face) {
     // match the plane normal
     if (face->vertices.size() < 3)
         return;
-    glm::vec3 v0 = face->vertices[0].position;
-    glm::vec3 v1 = face->vertices[1].position;
-    glm::vec3 v2 = face->vertices[2].position;
+    vec3_t v0 = face->vertices[0].position;
+    vec3_t v1 = face->vertices[1].position;
+    vec3_t v2 = face->vertices[2].position;
 
-    float d = dot(cross(v1-v0, v2-v0), face->plane->normal);
+    scalar_t d = dot(cross(v1-v0, v2-v0), face->plane->normal);
     if (d < 0) {
         reverse(face->vertices.begin(), face->vertices.end());
     }
 }
 
+// copy faces whose vertices refer to faces of the same array, so the copied
+// vertices refer to the copied faces. fragments are left behind
+static void copy_faces(const vector_t<face_t>& from, vector_t<face_t>& to) {
+    to.resize(from.size());
+    for (size_t i=0; i<from.size(); ++i) {
+        to[i].vertices = from[i].vertices;
+        to[i].fragments.clear();
+        for (auto& vertex: to[i].vertices) {
+            set_t<face_t*> faces;
+            for (face_t *face: vertex.faces)
+                faces.insert(&to[face - &from[0]]);
+            vertex.faces = std::move(faces);
+        }
+    }
+}
+
+static void set_face_plane_ids(brush_t *brush) {
+    for (size_t i=0; i<brush->faces.size(); ++i) {
+        face_t& face = brush->faces[i];
+        face.plane_id = brush->plane_ids[i];
+        const plane_t& shared = brush->world->get_plane(brush->plane_ids[i]);
+        face.plane_sign = (shared.normal == brush->planes[i].normal)? 1: -1;
+    }
+}
+
+#ifndef CSG_EXACT_PLANES
+static void cache_plane_crosses(brush_t *brush) {
+    // cache the cross products of every pair of plane normals, every plane
+    // triple below and every split of an edge between two of these planes
+    // reuses them
+    int n = brush->planes.size();
+    brush->plane_crosses.resize(n * n);
+    for (int i=0; i<n; ++i)
+    for (int j=i; j<n; ++j) {
+        intersection_vec3_t c = glm::cross(
+            intersection_vec3_t(brush->planes[i].normal),
+            intersection_vec3_t(brush->planes[j].normal)
+        );
+        brush->plane_crosses[i * n + j] = c;
+        brush->plane_crosses[j * n + i] = -c;
+    }
+}
+#endif
+
+void cache_face_planes(brush_t *brush) {
+    make_plane_soa(brush->planes, brush->plane_soa);
+#ifndef CSG_EXACT_PLANES
+    cache_plane_crosses(brush);
+#endif
+    for (size_t i=0; i<brush->faces.size(); ++i)
+        brush->faces[i].plane = &brush->planes[i];
+    set_face_plane_ids(brush);
+}
+
 static void rebuild_faces_and_box(brush_t *brush) {
     // printf("rebuild_faces_and_box\n"); fflush(stdout);
 
     brush->faces.clear();
+    brush->face_carves.clear();
 
     int n = brush->planes.size();
     brush->faces.resize(n);
-    for (int i=0; i<n; ++i) {
-        brush->faces[i].plane = &brush->planes[i];
-
-        // printf("plane %d: %f %f %f %f\n", 
-        //     i,
-        //     brush->faces[i].plane->normal.x,
-        //     brush->faces[i].plane->normal.y,
-        //     brush->faces[i].plane->normal.z,
-        //     brush->faces[i].plane->offset);
-
-    }
+    cache_face_planes(brush);
 
     vector_t<vertex_t> vshare;
+#ifdef CSG_EXACT_PLANES
+    vector_t<exact_point_t> vshare_points;
+#endif
     bool box_initialized = false;
 
     // build new vertices by intersecting each combination of 3 planes
@@ -250,10 +402,33 @@ static void rebuild_faces_and_box(brush_t *brush) {
         face_t *facej = &brush->faces[j];
         face_t *facek = &brush->faces[k];
         vertex_t v;
-        if (try_make_vertex(facei, facej, facek, v) && test(&v, brush) != RELATION_OUTSIDE) {
+#ifdef CSG_EXACT_PLANES
+        exact_point_t point;
+        bool made = try_make_exact_point(
+            brush->planes[i], brush->planes[j], brush->planes[k], point);
+        if (made) {
+            v.position = to_vec3(point);
+            v.faces = { facei, facej, facek };
+        }
+#else
+        bool made = try_make_vertex(
+            brush->planes[i], brush->planes[j], brush->planes[k],
+            brush->plane_crosses[i * n + j],
+            brush->plane_crosses[j * n + k],
+            brush->plane_crosses[k * n + i],
+            v.position
+        );
+#endif
+        if (made && test(&v, brush) != RELATION_OUTSIDE) {
             bool found_shared = false;
-            for (auto& shared: vshare) { // TODO: Better spatial search/hash? Or not necessary?
-                if (glm::length(shared.position - v.position) < 0.001) {
+            for (size_t s=0; s<vshare.size(); ++s) { // TODO: Better spatial search/hash? Or not necessary?
+                vertex_t& shared = vshare[s];
+#ifdef CSG_EXACT_PLANES
+                bool same = exact_equal(vshare_points[s], point);
+#else
+                bool same = glm::length(shared.position - v.position) < 0.001;
+#endif
+                if (same) {
                     shared.faces.insert(facei);
                     shared.faces.insert(facej);
                     shared.faces.insert(facek);
@@ -266,6 +441,9 @@ static void rebuild_faces_and_box(brush_t *brush) {
                 v.faces.insert(facej);
                 v.faces.insert(facek);
                 vshare.push_back(v);
+#ifdef CSG_EXACT_PLANES
+                vshare_points.push_back(point);
+#endif
             }
 
             if (!box_initialized) {
@@ -288,11 +466,84 @@ static void rebuild_faces_and_box(brush_t *brush) {
         order_vertices(&face);
         fix_winding(&face);
     }
+
+    // remember where the vertices came from for transform_faces_and_box,
+    // a shared shape keeps the faces of whichever brush built them first
+    shape_t *shape = brush->shape;
+    glm::dmat4 transform(brush->transform);
+    bool invertible = glm::determinant(glm::dmat3(transform)) > 0;
+    brush->faces_match_shape = false;
+    if (shape->has_positions && shape->shared)
+        return;
+    shape->has_positions = invertible;
+    shape->positions.clear();
+    if (!invertible)
+        return;
+    bool identity = (brush->transform == mat4_t(1));
+    glm::dmat4 inverse = glm::inverse(transform);
+    for (const auto& face: brush->faces)
+    for (const auto& vertex: face.vertices) {
+        shape->positions.push_back(identity? vertex.position:
+            vec3_t(inverse * glm::dvec4(glm::dvec3(vertex.position), 1.0)));
+    }
+    if (shape->shared) {
+        copy_faces(brush->faces, shape->faces);
+        for (size_t i=0; i<shape->faces.size(); ++i)
+            shape->faces[i].plane = &shape->planes[i];
+    }
+    brush->faces_match_shape = true;
+}
+
+static bool can_transform_faces(const brush_t *brush) {
+    // only once the shape's faces were built, by the brush itself or (for
+    // a shared shape) by any brush placed with it
+    const shape_t *shape = brush->shape;
+    return shape->has_positions && (brush->faces_match_shape || shape->shared);
 }
 
-static void split(fragment_t* fragment, face_t* splitter, fragment_t* front, fragment_t* back) {
-    // splits fragment into front and back piece w.r.t. face
-    // call only if test(fragment, face) == RELATION_SPLIT
+static void transform_faces_and_box(brush_t *brush) {
+    // same faces as the last rebuild_faces_and_box of the brush or of
+    // another one with the same shape, moved by the current transform
+    // (see brush_t::set_transform)
+    const shape_t *shape = brush->shape;
+    if (!brush->faces_match_shape) {
+        copy_faces(shape->faces, brush->faces);
+        for (size_t i=0; i<brush->faces.size(); ++i)
+            brush->faces[i].plane = &brush->planes[i];
+        brush->faces_match_shape = true;
+    }
+    brush->face_carves.clear();
+    cache_face_planes(brush);
+
+    glm::dmat4 transform(brush->transform);
+    bool box_initialized = false;
+    size_t index = 0;
+    for (auto& face: brush->faces)
+    for (auto& vertex: face.vertices) {
+        glm::dvec4 position = transform * glm::dvec4(glm::dvec3(shape->positions[index++]), 1.0);
+        vertex.position = vec3_t(position);
+        if (!box_initialized) {
+            brush->box = box_t{ vertex.position, vertex.position };
+            box_initialized = true;
+        } else {
+            brush->box = extended(brush->box, vertex.position);
+        }
+    }
+}
+
+static void split(
+    fragment_t* fragment,
+    const vector_t<relation_t>& relations,
+    face_t* splitter,
+    brush_t* owner,
+    brush_t* splitter_brush,
+    fragment_t* front,
+    fragment_t* back
+)
+{
+    // splits fragment into front and back piece w.r.t. face, relations
+    // are the vertex relations test(fragment, splitter) gave RELATION_SPLIT
+    // for
 
     map_t<relation_t, fragment_t*> pieces;
     pieces[RELATION_FRONT] = front;
@@ -307,24 +558,35 @@ static void split(fragment_t* fragment, face_t* splitter, fragment_t* front, fra
         piece->vertices.clear();
     }
 
+    auto keep_vertex = [&](relation_t rel, const vertex_t& v) {
+        // a vertex on the splitter plane belongs to both pieces
+        if (rel == RELATION_ALIGNED) {
+            front->vertices.push_back(v);
+            back->vertices.push_back(v);
+        } else {
+            pieces[rel]->vertices.push_back(v);
+        }
+    };
+
     int vertex_count = fragment->vertices.size();
     for (int i=0; i<vertex_count; ++i) {
         size_t j = (i+1) % vertex_count;
         vertex_t v0 = fragment->vertices[i];
         vertex_t v1 = fragment->vertices[j];
-        relation_t c0 = test(&v0, splitter);
-        relation_t c1 = test(&v1, splitter);
+        relation_t c0 = relations[i];
+        relation_t c1 = relations[j];
         if (c0 != c1) {
             edge_t edge;
             if (!try_get_edge(&v0, &v1, &edge)) {
                 // this shouldn't happen, but oh well...
-                pieces[c0]->vertices.push_back(v0);
+                keep_vertex(c0, v0);
                 continue;
             }
             vertex_t v;
-            if(!try_make_vertex(edge.faces[0], edge.faces[1], splitter, v)) {
+            if(!try_make_vertex(edge.faces[0], edge.faces[1], splitter,
+                                owner, splitter_brush, v)) {
                 // this shouldn't happen, but oh well...
-                pieces[c0]->vertices.push_back(v0);
+                keep_vertex(c0, v0);
                 continue;
             }
             v.faces.insert(edge.faces[0]);
@@ -340,16 +602,21 @@ static void split(fragment_t* fragment, face_t* splitter, fragment_t* front, fra
                 pieces[c0]->vertices.push_back(v);
                 pieces[c1]->vertices.push_back(v);
             }
-        } else {
+        } else if (c0 != RELATION_ALIGNED) {
             pieces[c0]->vertices.push_back(v0);
         }
+        // else: an edge lying in the splitter plane of a fragment that
+        // still has vertices on both sides is a rounding artefact, its
+        // endpoints were already emitted by the neighbouring edges
     }
 }
 
 static vector_t<fragment_t> carve(
     fragment_t fragment,
+    brush_t* owner,
     brush_t* brush,
-    size_t face_index
+    size_t face_index,
+    vector_t<relation_t>& relations
 )
 {
     // this carves the given fragment into pieces that can be uniquely 
@@ -364,7 +631,7 @@ static vector_t<fragment_t> carve(
     }
 
     face_t* face = &brush->faces[face_index];
-    relation_t rel = test(&fragment, face);
+    relation_t rel = test(&fragment, face, relations);
     switch (rel) {
         case RELATION_FRONT:
             // early out: if the fragment is in front of any plane it
@@ -376,15 +643,22 @@ static vector_t<fragment_t> carve(
             fragment.relation = rel;  // intentional fallthrough!
         case RELATION_BACK:
             // push the fragment further down the bsp-tree
-            return carve(std::move(fragment), brush, face_index+1);
+            return carve(std::move(fragment), owner, brush, face_index+1, relations);
         case RELATION_SPLIT:{
             fragment_t front;
             fragment_t back;
-            split(&fragment, face, &front, &back);
+            split(&fragment, relations, face, owner, brush, &front, &back);
+
+            // the pieces are identified by which plane split them off
+            uint64_t split_id = hash_combine(fragment.id, brush->uid);
+            split_id = hash_combine(split_id, brush->planes_version);
+            split_id = hash_combine(split_id, face_index);
+            front.id = hash_combine(split_id, RELATION_FRONT);
+            back.id  = hash_combine(split_id, RELATION_BACK);
 
             // push the back fragment further down the bsp-tree
             back.relation = fragment.relation;
-            auto rest = carve(std::move(back), brush, face_index+1);
+            auto rest = carve(std::move(back), owner, brush, face_index+1, relations);
 
             // prevent some redundant splitting
             if (rest.size() == 1 && rest[0].relation == RELATION_OUTSIDE) {
@@ -403,110 +677,280 @@ static vector_t<fragment_t> carve(
     return {};
 }
 
-static void rebuild_fragments(brush_t *brush) {
-    for (face_t& face: brush->faces) {
-        face.fragments.clear(); 
-
-        // initialize the first fragment
-        face.fragments.emplace_back();
-        
-        {
-            volume_t void_volume  = brush->world->void_volume;
-            fragment_t* fragment  = &face.fragments.back();
-            fragment->face        = &face;
-            fragment->back_volume = brush->volume_operation(void_volume);
-            fragment->front_volume= void_volume;
-            fragment->back_brush  = brush;
-            fragment->front_brush = nullptr;
-            fragment->vertices    = face.vertices;
-
-            // printf("FRONT %d BACK %d\n",
-            // fragment->front_volume,
-            // fragment->back_volume);
-            // fflush(stdout);
+static box_t polygon_box(const vector_t<vertex_t>& vertices) {
+    box_t box{ vertices[0].position, vertices[0].position };
+    for (const vertex_t& vertex: vertices)
+        box = extended(box, vertex.position);
+    return box;
+}
+
+static bool face_is_dirty(const brush_t *brush, const face_t& face) {
+    // a brush can only change the fragments of faces that overlap its box,
+    // so a face none of the dirty regions touch keeps its fragments (with
+    // the same margin as for finding intersecting brushes)
+    if (brush->all_faces_dirty)
+        return true;
+    if (face.vertices.empty())
+        return false;
+    box_t face_box = polygon_box(face.vertices);
+    for (const box_t& dirty: brush->dirty_boxes) {
+        if (box_intersects_box(face_box, box_t{ dirty.min - box_margin, dirty.max + box_margin }))
+            return true;
+    }
+    return false;
+}
+
+static void carve_face(brush_t *brush, face_t& face, face_carve_t& cache,
+                       const vector_t<brush_t*>& carvers)
+{
+    // split the face polygon by every carving brush (in uid order, so the
+    // result doesn't depend on times or volume operations) and remember
+    // each piece's relation to each of them. the result only depends on
+    // the planes involved, so it is kept until one of them changes
+    vector_t<std::pair<int, int>> key;
+    for (brush_t* carver: carvers)
+        key.emplace_back(carver->uid, carver->planes_version);
+    if (!cache.pieces.empty() && key == cache.carvers)
+        return;
+    cache.carvers = std::move(key);
+
+    cache.pieces.clear();
+    cache.pieces.emplace_back();
+    cache.pieces.back().vertices = face.vertices;
+    cache.pieces.back().relations.assign(carvers.size(), RELATION_OUTSIDE);
+    uint64_t face_id = hash_combine(brush->uid, brush->planes_version);
+    cache.pieces.back().id = hash_combine(face_id, &face - brush->faces.data());
+
+    vector_t<relation_t> relations; // scratch for carve
+    for (size_t k=0; k<carvers.size(); ++k) {
+        vector_t<carved_piece_t> pieces;
+        for (carved_piece_t& piece: cache.pieces) {
+            fragment_t fragment;
+            fragment.face         = &face;
+            fragment.vertices     = std::move(piece.vertices);
+            fragment.front_volume = 0;
+            fragment.back_volume  = 0;
+            fragment.front_brush  = nullptr;
+            fragment.back_brush   = nullptr;
+            fragment.relation     = RELATION_INSIDE;
+            fragment.id           = piece.id;
+            for (fragment_t& carved: carve(std::move(fragment), brush, carvers[k], 0, relations)) {
+                pieces.emplace_back();
+                pieces.back().vertices  = std::move(carved.vertices);
+                pieces.back().relations = piece.relations;
+                pieces.back().relations[k] = carved.relation;
+                pieces.back().id        = carved.id;
+            }
+        }
+        cache.pieces = std::move(pieces);
+    }
+}
+
+static void add_fragment_changes(brush_t *brush, int face_index,
+                                 vector_t<uint64_t>& old_ids)
+{
+    // every fragment of the rebuilt face is kept or added, whatever is
+    // left of the old ids was removed
+    const face_t& face = brush->faces[face_index];
+    vector_t<fragment_change_t>& changes = brush->world->fragment_changes;
+    std::sort(old_ids.begin(), old_ids.end());
+    vector_t<bool> old_found(old_ids.size(), false);
+    for (size_t i=0; i<face.fragments.size(); ++i) {
+        uint64_t id = face.fragments[i].id;
+        auto it = std::lower_bound(old_ids.begin(), old_ids.end(), id);
+        bool kept = (it != old_ids.end() && *it == id);
+        if (kept)
+            old_found[it - old_ids.begin()] = true;
+        changes.push_back(fragment_change_t{
+            brush, face_index, int(i), kept? FRAGMENT_KEPT: FRAGMENT_ADDED, id
+        });
+    }
+    for (size_t i=0; i<old_ids.size(); ++i) {
+        if (!old_found[i])
+            changes.push_back(fragment_change_t{ brush, face_index, -1, FRAGMENT_REMOVED, old_ids[i] });
+    }
+}
+
+static bool rebuild_fragments(brush_t *brush) {
+    // returns whether any face was rebuilt
+    bool rebuilt = false;
+    bool track_changes = brush->world->track_fragment_changes;
+    vector_t<uint64_t> old_ids;
+    brush->face_carves.resize(brush->faces.size());
+    for (size_t face_index=0; face_index<brush->faces.size(); ++face_index) {
+        face_t& face = brush->faces[face_index];
+        if (!face_is_dirty(brush, face))
+            continue;
+        rebuilt = true;
+        old_ids.clear();
+        if (track_changes) {
+            for (const fragment_t& fragment: face.fragments)
+                old_ids.push_back(fragment.id);
+        }
+        face.fragments.clear();
+        if (face.vertices.empty()) {
+            if (track_changes)
+                add_fragment_changes(brush, face_index, old_ids);
+            continue;
+        }
+
+        // only brushes overlapping the face polygon can carve it (grown by the
+        // margin, a brush can touch the face and still be a rounding error off)
+        box_t face_box = polygon_box(face.vertices);
+        face_box = box_t{ face_box.min - box_margin, face_box.max + box_margin };
+        vector_t<brush_t*> carvers;
+        for (brush_t* intersecting: brush->intersecting_brushes) {
+            if (box_intersects_box(face_box, intersecting->box))
+                carvers.push_back(intersecting);
+        }
+        vector_t<brush_t*> ordered = carvers; // intersecting_brushes are in csg order
+        std::sort(carvers.begin(), carvers.end(), [](brush_t* b0, brush_t* b1) {
+            return b0->uid < b1->uid;
+        });
+
+        face_carve_t& cache = brush->face_carves[face_index];
+        carve_face(brush, face, cache, carvers);
+
+        // index of each carver (csg order) in the cached relations (uid order)
+        vector_t<int> relation_index;
+        for (brush_t* intersecting: ordered) {
+            auto it = std::lower_bound(carvers.begin(), carvers.end(), intersecting,
+                [](brush_t* b0, brush_t* b1) { return b0->uid < b1->uid; });
+            relation_index.push_back(it - carvers.begin());
         }
 
         /*
             HEART OF THE ALGORITHM
-            use each intersecting brush to carve this brush's fragments into
-            pieces, then depending on the piece's relation to the intersecting
-            brush (inside/outside/aligned/reverse aligned) and the relative time
-            between this brush and the intersecting brush-- adjust the piece's
-            front/back volumes, or potentially discard the piece
+            each piece of the face (see carve_face) is uniquely inside/outside/
+            aligned/reverse aligned with each intersecting brush. go through
+            them in csg order and depending on the piece's relation to the
+            intersecting brush and the relative time between this brush and
+            the intersecting brush-- adjust the piece's front/back volumes,
+            or potentially discard the piece
         */
-        for (brush_t* intersecting: brush->intersecting_brushes) {
-            bool before_intersecting = b0_before_b1(brush, intersecting);
-            int fragment_count = face.fragments.size();
-            
-            for (int fragment_index = fragment_count-1;
-                fragment_index >= 0;
-                --fragment_index)
-            {
-                fragment_t fragment = std::move(face.fragments[fragment_index]);
-                face.fragments.erase(face.fragments.begin() + fragment_index);
-
-                fragment.relation = RELATION_INSIDE;
-                vector_t<fragment_t> pieces = carve(std::move(fragment), intersecting, 0);
-                for (auto& piece: pieces) {
-                    bool keep_piece = true;
-                    switch(piece.relation) {
-                        case RELATION_INSIDE:
-                            if (before_intersecting) {
-                                piece.back_volume = intersecting->volume_operation(piece.back_volume);
-                                piece.back_brush = intersecting;
-                            }
+        volume_t void_volume = brush->world->void_volume;
+        for (const carved_piece_t& carved: cache.pieces) {
+            fragment_t piece;
+            piece.face         = &face;
+            piece.back_volume  = brush->volume_operation(void_volume);
+            piece.front_volume = void_volume;
+            piece.back_brush   = brush;
+            piece.front_brush  = nullptr;
+            piece.relation     = RELATION_OUTSIDE;
+
+            bool keep_piece = true;
+            for (size_t i=0; i<ordered.size() && keep_piece; ++i) {
+                brush_t* intersecting = ordered[i];
+                bool before_intersecting = b0_before_b1(brush, intersecting);
+                switch(carved.relations[relation_index[i]]) {
+                    case RELATION_INSIDE:
+                        if (before_intersecting) {
+                            piece.back_volume = intersecting->volume_operation(piece.back_volume);
+                            piece.back_brush = intersecting;
+                        }
+                        piece.front_volume = intersecting->volume_operation(piece.front_volume);
+                        piece.front_brush = intersecting;
+                        break;
+                    case RELATION_ALIGNED:
+                        if (before_intersecting)
+                            keep_piece = false;
+                        break;
+                    case RELATION_REVERSE_ALIGNED:
+                        if (before_intersecting) {
+                            keep_piece = false;
+                        } else {
                             piece.front_volume = intersecting->volume_operation(piece.front_volume);
                             piece.front_brush = intersecting;
-                            break;
-                        case RELATION_ALIGNED:
-                            if (before_intersecting)
-                                keep_piece = false;
-                            break;
-                        case RELATION_REVERSE_ALIGNED:
-                            if (before_intersecting) {
-                                keep_piece = false;
-                            } else {
-                                piece.front_volume = intersecting->volume_operation(piece.front_volume);
-                                piece.front_brush = intersecting;
-                            }
-                            break;
-                    }
-                    if (keep_piece)
-                        face.fragments.emplace_back(std::move(piece));
+                        }
+                        break;
                 }
             }
+            if (keep_piece) {
+                piece.vertices = carved.vertices;
+                piece.id = hash_combine(carved.id, uint32_t(piece.front_volume));
+                piece.id = hash_combine(piece.id, uint32_t(piece.back_volume));
+                piece.id = hash_combine(piece.id, piece.front_brush? piece.front_brush->uid + 1: 0);
+                piece.id = hash_combine(piece.id, piece.back_brush->uid);
+                face.fragments.emplace_back(std::move(piece));
+            }
         }
+        if (track_changes)
+            add_fragment_changes(brush, face_index, old_ids);
     }
+    brush->dirty_boxes.clear();
+    brush->all_faces_dirty = false;
+    return rebuilt;
 }
 
-set_t<brush_t*> world_t::rebuild() {
+const vector_t<change_t>& world_t::rebuild() {
     // todo: parallelize per-brush work
 
-    for (brush_t* brush: need_face_and_box_rebuild) {
-        rebuild_faces_and_box(brush);
-        need_fragment_rebuild.insert(brush);
+    // brushes reported as removed by the last rebuild are gone for good
+    for (const change_t& change: changes) {
+        if (change.kinds & CHANGE_REMOVED)
+            delete change.brush;
+    }
+    changes.clear();
+    fragment_changes.clear();
+
+    apply_pending_edits(this);
+
+    auto by_uid = [](brush_t *b0, brush_t *b1) { return b0->uid < b1->uid; };
+    std::sort(dirty_brushes.begin(), dirty_brushes.end(), by_uid);
+
+    const int box_changed = NEED_FACE_AND_BOX_REBUILD | NEED_FACE_TRANSFORM;
+    for (brush_t* brush: dirty_brushes) {
+        if (!(brush->needs & box_changed))
+            continue;
+        box_t old_box = brush->box;
+        // brushes go by uid, so of the brushes placed with a new shape the
+        // first one builds its faces here and the others move them
+        if ((brush->needs & NEED_FACE_AND_BOX_REBUILD) || !can_transform_faces(brush)) {
+            rebuild_faces_and_box(brush);
+        } else {
+            transform_faces_and_box(brush);
+            brush->change_kinds |= CHANGE_MOVED;
+        }
+        mark_all_faces_dirty(brush);
+        brush->change_kinds |= CHANGE_FACES;
+        if (brush->box.min != old_box.min || brush->box.max != old_box.max)
+            brush->change_kinds |= CHANGE_BOX;
     }
 
-    for (brush_t* brush: need_face_and_box_rebuild) {
+    // marking the neighbours appends to dirty_brushes, the new ones only
+    // need their fragments rebuilt
+    size_t count = dirty_brushes.size();
+    for (size_t i=0; i<count; ++i) {
+        brush_t *brush = dirty_brushes[i];
+        if (!(brush->needs & box_changed))
+            continue;
         recalculate_intersecting_brushes(brush);
         for (brush_t* intersecting: brush->intersecting_brushes) {
-            need_fragment_rebuild.insert(intersecting);
+            mark_faces_dirty(intersecting, brush->box);
         }        
     }
+    std::sort(dirty_brushes.begin(), dirty_brushes.end(), by_uid);
 
-    for (brush_t* brush: need_fragment_rebuild) {
-        if (!need_face_and_box_rebuild.contains(brush)) {
+    for (brush_t* brush: dirty_brushes) {
+        if (!(brush->needs & box_changed)) {
             recalculate_intersecting_brushes(brush);
         }
-        rebuild_fragments(brush);
+        if ((brush->needs & NEED_FRAGMENT_REBUILD) && rebuild_fragments(brush))
+            brush->change_kinds |= CHANGE_FRAGMENTS;
+        if (brush->change_kinds != 0)
+            changes.push_back(change_t{ brush, brush->change_kinds });
+        brush->needs = 0;
+        brush->change_kinds = 0;
+        brush->version.reset();
     }
+    dirty_brushes.clear();
 
-    set_t<brush_t*> rebuilt_brushes = need_fragment_rebuild;
-
-    need_face_and_box_rebuild.clear();
-    need_fragment_rebuild.clear();
+    std::sort(removed_brushes.begin(), removed_brushes.end(), by_uid);
+    for (brush_t* brush: removed_brushes)
+        changes.push_back(change_t{ brush, CHANGE_REMOVED });
+    removed_brushes.clear();
 
-    return rebuilt_brushes;
+    return changes;
 }
 
 }
\ No newline at end of file
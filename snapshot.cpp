@@ -0,0 +1,475 @@
+#include "csg_private.hpp"
+#include <algorithm>
+#include <string.h>
+
+namespace csg {
+
+static constexpr size_t snapshot_alignment = 8;
+
+static size_t aligned(size_t offset) {
+    return (offset + snapshot_alignment - 1) / snapshot_alignment * snapshot_alignment;
+}
+
+static bool get_operation(const volume_operation_t& operation, snapshot_brush_t& record) {
+    record.volume_from = 0;
+    record.volume_to = 0;
+    if (operation.target<std::identity>()) {
+        record.operation = SNAPSHOT_OPERATION_IDENTITY;
+    } else if (const fill_operation_t *fill = operation.target<fill_operation_t>()) {
+        record.operation = SNAPSHOT_OPERATION_FILL;
+        record.volume_to = fill->with;
+    } else if (const convert_operation_t *convert = operation.target<convert_operation_t>()) {
+        record.operation = SNAPSHOT_OPERATION_CONVERT;
+        record.volume_from = convert->from;
+        record.volume_to = convert->to;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static volume_operation_t make_operation(const snapshot_brush_t& record) {
+    switch (record.operation) {
+        case SNAPSHOT_OPERATION_FILL:
+            return make_fill_operation(record.volume_to);
+        case SNAPSHOT_OPERATION_CONVERT:
+            return make_convert_operation(record.volume_from, record.volume_to);
+    }
+    return std::identity{};
+}
+
+// the records of a snapshot before they are laid out
+struct snapshot_arrays_t {
+    vector_t<snapshot_brush_t>    brushes;
+    vector_t<plane_t>             planes;
+    vector_t<snapshot_face_t>     faces;
+    vector_t<snapshot_fragment_t> fragments;
+    vector_t<snapshot_vertex_t>   vertices;
+    vector_t<uint32_t>            vertex_faces;
+    vector_t<uint32_t>            intersecting;
+    vector_t<snapshot_shape_t>    shapes;
+    vector_t<plane_t>             shape_planes;
+};
+
+static int32_t add_shape(const shape_t *shape, int32_t kind, snapshot_arrays_t& arrays) {
+    snapshot_shape_t record;
+    record.kind = kind;
+    record.first_plane = uint32_t(arrays.shape_planes.size());
+    record.plane_count = uint32_t(shape->planes.size());
+    arrays.shape_planes.insert(arrays.shape_planes.end(), shape->planes.begin(), shape->planes.end());
+    arrays.shapes.push_back(record);
+    return int32_t(arrays.shapes.size()) - 1;
+}
+
+// vertex_t::faces can point at faces of any brush, they are found by the
+// start of their brush's faces
+struct face_index_t {
+    map_t<const face_t*, uint32_t> first_faces;
+
+    uint32_t operator()(const face_t *face) const {
+        auto it = std::prev(first_faces.upper_bound(face));
+        return it->second + uint32_t(face - it->first);
+    }
+};
+
+static void add_vertices(const vector_t<vertex_t>& vertices, const face_index_t& face_index,
+                         snapshot_arrays_t& arrays)
+{
+    for (const vertex_t& vertex: vertices) {
+        snapshot_vertex_t record;
+        record.position = vertex.position;
+        record.first_face = uint32_t(arrays.vertex_faces.size());
+        record.face_count = uint32_t(vertex.faces.size());
+        for (const face_t *face: vertex.faces)
+            arrays.vertex_faces.push_back(face_index(face));
+        arrays.vertices.push_back(record);
+    }
+}
+
+template<class T>
+static uint64_t add_array(const vector_t<T>& array, size_t& size) {
+    uint64_t offset = size;
+    size = aligned(size + array.size() * sizeof(T));
+    return offset;
+}
+
+template<class T>
+static void write_array(const vector_t<T>& array, uint64_t offset, vector_t<uint8_t>& data) {
+    if (!array.empty())
+        memcpy(data.data() + offset, array.data(), array.size() * sizeof(T));
+}
+
+bool save_snapshot(world_t *world, int flags, vector_t<uint8_t>& data) {
+    data.clear();
+    bool computed = (flags & SNAPSHOT_COMPUTED) != 0;
+    if (computed && (!world->dirty_brushes.empty() || !world->edited_brushes.empty()))
+        return false;
+
+    snapshot_arrays_t arrays;
+    map_t<const brush_t*, int32_t> brush_index;
+    face_index_t face_index;
+    // the world's shapes come first and in order, shared shapes removed
+    // from the world are added with the first brush using them
+    map_t<const shape_t*, int32_t> shape_index;
+    for (const shape_t *shape: world->shapes)
+        shape_index[shape] = add_shape(shape, SNAPSHOT_SHAPE_SHARED, arrays);
+    for (brush_t *brush = world->first(); brush; brush = world->next(brush)) {
+        face_index.first_faces[brush->faces.data()] = uint32_t(arrays.planes.size());
+        brush_index[brush] = int32_t(arrays.brushes.size());
+
+        snapshot_brush_t record;
+        memset(&record, 0, sizeof(record));
+        record.uid = brush->uid;
+        record.time = brush->time;
+        record.planes_version = brush->planes_version;
+        if (!get_operation(brush->volume_operation, record))
+            return false;
+        record.first_plane = uint32_t(arrays.planes.size());
+        record.plane_count = uint32_t(brush->planes.size());
+        record.box = brush->box;
+        record.transform = brush->transform;
+        record.shape = -1;
+        if (brush->shape && brush->shape->shared) {
+            auto it = shape_index.find(brush->shape);
+            if (it == shape_index.end())
+                it = shape_index.emplace(brush->shape, add_shape(brush->shape, SNAPSHOT_SHAPE_REMOVED, arrays)).first;
+            record.shape = it->second;
+        } else if (brush->shape && brush->transform != mat4_t(1)) {
+            record.shape = add_shape(brush->shape, SNAPSHOT_SHAPE_OWN, arrays);
+        }
+        arrays.planes.insert(arrays.planes.end(), brush->planes.begin(), brush->planes.end());
+        arrays.brushes.push_back(record);
+    }
+
+    if (computed) {
+        size_t index = 0;
+        for (brush_t *brush = world->first(); brush; brush = world->next(brush), ++index) {
+            snapshot_brush_t& record = arrays.brushes[index];
+            record.first_intersecting = uint32_t(arrays.intersecting.size());
+            record.intersecting_count = uint32_t(brush->intersecting_brushes.size());
+            for (const brush_t *intersecting: brush->intersecting_brushes)
+                arrays.intersecting.push_back(uint32_t(brush_index[intersecting]));
+
+            for (const face_t& face: brush->faces) {
+                snapshot_face_t face_record;
+                face_record.first_vertex = uint32_t(arrays.vertices.size());
+                face_record.vertex_count = uint32_t(face.vertices.size());
+                add_vertices(face.vertices, face_index, arrays);
+                face_record.first_fragment = uint32_t(arrays.fragments.size());
+                face_record.fragment_count = uint32_t(face.fragments.size());
+                for (const fragment_t& fragment: face.fragments) {
+                    snapshot_fragment_t fragment_record;
+                    fragment_record.id = fragment.id;
+                    fragment_record.first_vertex = uint32_t(arrays.vertices.size());
+                    fragment_record.vertex_count = uint32_t(fragment.vertices.size());
+                    fragment_record.front_volume = fragment.front_volume;
+                    fragment_record.back_volume = fragment.back_volume;
+                    fragment_record.front_brush = fragment.front_brush? brush_index[fragment.front_brush]: -1;
+                    fragment_record.back_brush = brush_index[fragment.back_brush];
+                    add_vertices(fragment.vertices, face_index, arrays);
+                    arrays.fragments.push_back(fragment_record);
+                }
+                arrays.faces.push_back(face_record);
+            }
+        }
+    }
+
+    snapshot_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = snapshot_magic;
+    header.version = snapshot_version;
+    header.scalar_size = sizeof(scalar_t);
+    header.flags = computed? SNAPSHOT_COMPUTED: 0;
+    header.void_volume = world->void_volume;
+    header.next_uid = world->next_uid;
+    header.brush_count = uint32_t(arrays.brushes.size());
+    header.plane_count = uint32_t(arrays.planes.size());
+    header.face_count = uint32_t(arrays.faces.size());
+    header.fragment_count = uint32_t(arrays.fragments.size());
+    header.vertex_count = uint32_t(arrays.vertices.size());
+    header.vertex_face_count = uint32_t(arrays.vertex_faces.size());
+    header.intersecting_count = uint32_t(arrays.intersecting.size());
+    header.shape_count = uint32_t(arrays.shapes.size());
+    header.shape_plane_count = uint32_t(arrays.shape_planes.size());
+
+    size_t size = aligned(sizeof(header));
+    header.brushes = add_array(arrays.brushes, size);
+    header.planes = add_array(arrays.planes, size);
+    header.faces = add_array(arrays.faces, size);
+    header.fragments = add_array(arrays.fragments, size);
+    header.vertices = add_array(arrays.vertices, size);
+    header.vertex_faces = add_array(arrays.vertex_faces, size);
+    header.intersecting = add_array(arrays.intersecting, size);
+    header.shapes = add_array(arrays.shapes, size);
+    header.shape_planes = add_array(arrays.shape_planes, size);
+    header.size = size;
+
+    data.assign(size, 0);
+    memcpy(data.data(), &header, sizeof(header));
+    write_array(arrays.brushes, header.brushes, data);
+    write_array(arrays.planes, header.planes, data);
+    write_array(arrays.faces, header.faces, data);
+    write_array(arrays.fragments, header.fragments, data);
+    write_array(arrays.vertices, header.vertices, data);
+    write_array(arrays.vertex_faces, header.vertex_faces, data);
+    write_array(arrays.intersecting, header.intersecting, data);
+    write_array(arrays.shapes, header.shapes, data);
+    write_array(arrays.shape_planes, header.shape_planes, data);
+    return true;
+}
+
+template<class T>
+static bool get_array(const uint8_t *data, const snapshot_header_t& header,
+                      uint64_t offset, uint32_t count, const T*& array)
+{
+    if (offset % snapshot_alignment != 0 || offset > header.size ||
+        count > (header.size - offset) / sizeof(T))
+        return false;
+    array = reinterpret_cast<const T*>(data + offset);
+    return true;
+}
+
+static bool in_range(uint32_t first, uint32_t count, uint32_t size) {
+    return first <= size && count <= size - first;
+}
+
+bool open_snapshot(const void *data, size_t size, snapshot_t& snapshot) {
+    const uint8_t *bytes = static_cast<const uint8_t*>(data);
+    if (size < sizeof(snapshot_header_t) || uintptr_t(bytes) % snapshot_alignment != 0)
+        return false;
+    const snapshot_header_t& header = *reinterpret_cast<const snapshot_header_t*>(bytes);
+    if (header.magic != snapshot_magic || header.version != snapshot_version ||
+        header.scalar_size != sizeof(scalar_t) || header.size > size)
+        return false;
+    bool computed = (header.flags & SNAPSHOT_COMPUTED) != 0;
+    if (computed? header.face_count != header.plane_count: header.face_count != 0)
+        return false;
+
+    snapshot.header = &header;
+    if (!get_array(bytes, header, header.brushes, header.brush_count, snapshot.brushes) ||
+        !get_array(bytes, header, header.planes, header.plane_count, snapshot.planes) ||
+        !get_array(bytes, header, header.faces, header.face_count, snapshot.faces) ||
+        !get_array(bytes, header, header.fragments, header.fragment_count, snapshot.fragments) ||
+        !get_array(bytes, header, header.vertices, header.vertex_count, snapshot.vertices) ||
+        !get_array(bytes, header, header.vertex_faces, header.vertex_face_count, snapshot.vertex_faces) ||
+        !get_array(bytes, header, header.intersecting, header.intersecting_count, snapshot.intersecting) ||
+        !get_array(bytes, header, header.shapes, header.shape_count, snapshot.shapes) ||
+        !get_array(bytes, header, header.shape_planes, header.shape_plane_count, snapshot.shape_planes))
+        return false;
+
+    for (uint32_t i=0; i<header.shape_count; ++i) {
+        const snapshot_shape_t& shape = snapshot.shapes[i];
+        if (!in_range(shape.first_plane, shape.plane_count, header.shape_plane_count) ||
+            shape.kind < SNAPSHOT_SHAPE_OWN || shape.kind > SNAPSHOT_SHAPE_REMOVED)
+            return false;
+    }
+    // besides staying in bounds, the records have to be laid out the way
+    // save_snapshot writes them: each array is split up into consecutive
+    // ranges by the records referring to it, in order and without gaps
+    uint32_t next_plane = 0, next_intersecting = 0;
+    for (uint32_t i=0; i<header.brush_count; ++i) {
+        const snapshot_brush_t& brush = snapshot.brushes[i];
+        if (brush.first_plane != next_plane || !in_range(brush.first_plane, brush.plane_count, header.plane_count) ||
+            brush.operation < SNAPSHOT_OPERATION_IDENTITY || brush.operation > SNAPSHOT_OPERATION_CONVERT ||
+            brush.uid >= header.next_uid || (i > 0 && brush.uid <= snapshot.brushes[i-1].uid))
+            return false;
+        if (brush.shape < -1 || brush.shape >= int32_t(header.shape_count) ||
+            (brush.shape >= 0 && snapshot.shapes[brush.shape].plane_count != brush.plane_count))
+            return false;
+        next_plane += brush.plane_count;
+        if (!computed)
+            continue;
+        if (brush.first_intersecting != next_intersecting ||
+            !in_range(brush.first_intersecting, brush.intersecting_count, header.intersecting_count))
+            return false;
+        next_intersecting += brush.intersecting_count;
+        for (uint32_t k=0; k<brush.intersecting_count; ++k) {
+            if (snapshot.intersecting[brush.first_intersecting + k] == i)
+                return false;
+        }
+    }
+    if (next_plane != header.plane_count || next_intersecting != header.intersecting_count)
+        return false;
+
+    // the vertices of each face come before those of its fragments
+    uint32_t next_vertex = 0, next_fragment = 0;
+    auto take_vertices = [&](uint32_t first, uint32_t count) {
+        if (first != next_vertex || !in_range(first, count, header.vertex_count))
+            return false;
+        next_vertex += count;
+        return true;
+    };
+    for (uint32_t i=0; i<header.face_count; ++i) {
+        const snapshot_face_t& face = snapshot.faces[i];
+        if (!take_vertices(face.first_vertex, face.vertex_count) ||
+            face.first_fragment != next_fragment ||
+            !in_range(face.first_fragment, face.fragment_count, header.fragment_count))
+            return false;
+        next_fragment += face.fragment_count;
+        for (uint32_t k=0; k<face.fragment_count; ++k) {
+            const snapshot_fragment_t& fragment = snapshot.fragments[face.first_fragment + k];
+            if (!take_vertices(fragment.first_vertex, fragment.vertex_count) ||
+                fragment.front_brush < -1 || fragment.front_brush >= int32_t(header.brush_count) ||
+                fragment.back_brush < 0 || fragment.back_brush >= int32_t(header.brush_count))
+                return false;
+        }
+    }
+    if (next_vertex != header.vertex_count || next_fragment != header.fragment_count)
+        return false;
+
+    uint32_t next_vertex_face = 0;
+    for (uint32_t i=0; i<header.vertex_count; ++i) {
+        const snapshot_vertex_t& vertex = snapshot.vertices[i];
+        if (vertex.first_face != next_vertex_face ||
+            !in_range(vertex.first_face, vertex.face_count, header.vertex_face_count))
+            return false;
+        next_vertex_face += vertex.face_count;
+    }
+    if (next_vertex_face != header.vertex_face_count)
+        return false;
+    for (uint32_t i=0; i<header.vertex_face_count; ++i) {
+        if (snapshot.vertex_faces[i] >= header.face_count)
+            return false;
+    }
+    for (uint32_t i=0; i<header.intersecting_count; ++i) {
+        if (snapshot.intersecting[i] >= header.brush_count)
+            return false;
+    }
+
+    // a vertex of a face is a corner of its brush, it lies on the face
+    // and only on other faces of the same brush
+    if (computed) {
+        for (uint32_t i=0; i<header.brush_count; ++i) {
+            const snapshot_brush_t& brush = snapshot.brushes[i];
+            for (uint32_t f=brush.first_plane; f<brush.first_plane + brush.plane_count; ++f) {
+                const snapshot_face_t& face = snapshot.faces[f];
+                for (uint32_t v=face.first_vertex; v<face.first_vertex + face.vertex_count; ++v) {
+                    const snapshot_vertex_t& vertex = snapshot.vertices[v];
+                    bool on_face = false;
+                    for (uint32_t k=0; k<vertex.face_count; ++k) {
+                        uint32_t vertex_face = snapshot.vertex_faces[vertex.first_face + k];
+                        if (vertex_face < brush.first_plane || vertex_face >= brush.first_plane + brush.plane_count)
+                            return false;
+                        on_face = on_face || vertex_face == f;
+                    }
+                    if (!on_face)
+                        return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+static void load_vertices(const snapshot_t& snapshot, uint32_t first, uint32_t count,
+                          const vector_t<face_t*>& faces, vector_t<vertex_t>& vertices)
+{
+    vertices.resize(count);
+    for (uint32_t i=0; i<count; ++i) {
+        const snapshot_vertex_t& record = snapshot.vertices[first + i];
+        vertices[i].position = record.position;
+        for (uint32_t f=0; f<record.face_count; ++f)
+            vertices[i].faces.insert(faces[snapshot.vertex_faces[record.first_face + f]]);
+    }
+}
+
+bool load_snapshot(world_t *world, const snapshot_t& snapshot) {
+    if (world->first() || world->edit_depth != 0)
+        return false;
+    const snapshot_header_t& header = *snapshot.header;
+    world->void_volume = header.void_volume;
+
+    vector_t<shape_t*> shapes(header.shape_count, nullptr);
+    vector_t<plane_t> planes;
+    for (uint32_t i=0; i<header.shape_count; ++i) {
+        const snapshot_shape_t& record = snapshot.shapes[i];
+        if (record.kind == SNAPSHOT_SHAPE_OWN)
+            continue;
+        planes.assign(snapshot.shape_planes + record.first_plane,
+                      snapshot.shape_planes + record.first_plane + record.plane_count);
+        shapes[i] = world->add_shape(planes);
+    }
+
+    // placing a brush with its shape gives back the planes it was saved
+    // with, the transform goes through the same steps
+    vector_t<brush_t*> brushes(header.brush_count);
+    for (uint32_t i=0; i<header.brush_count; ++i) {
+        const snapshot_brush_t& record = snapshot.brushes[i];
+        brush_t *brush = world->add();
+        brush->uid = record.uid;
+        if (record.shape < 0) {
+            planes.assign(snapshot.planes + record.first_plane,
+                          snapshot.planes + record.first_plane + record.plane_count);
+            brush->set_planes(planes);
+        } else if (shapes[record.shape]) {
+            brush->set_shape(shapes[record.shape]);
+            brush->set_transform(record.transform);
+        } else {
+            const snapshot_shape_t& shape = snapshot.shapes[record.shape];
+            planes.assign(snapshot.shape_planes + shape.first_plane,
+                          snapshot.shape_planes + shape.first_plane + shape.plane_count);
+            brush->set_planes(planes);
+            brush->set_transform(record.transform);
+        }
+        brush->planes_version = record.planes_version;
+        brush->time = record.time;
+        brush->volume_operation = make_operation(record);
+        brushes[i] = brush;
+    }
+    world->next_uid = std::max(world->next_uid, header.next_uid);
+    // the world only kept these for the brushes still placed with them
+    for (uint32_t i=0; i<header.shape_count; ++i) {
+        if (snapshot.shapes[i].kind == SNAPSHOT_SHAPE_REMOVED)
+            world->remove_shape(shapes[i]);
+    }
+    if (!(header.flags & SNAPSHOT_COMPUTED))
+        return true;
+
+    // all faces first, vertices can point at faces of any brush
+    vector_t<face_t*> faces(header.face_count);
+    for (uint32_t i=0; i<header.brush_count; ++i) {
+        const snapshot_brush_t& record = snapshot.brushes[i];
+        brushes[i]->faces.resize(record.plane_count);
+        for (uint32_t f=0; f<record.plane_count; ++f)
+            faces[record.first_plane + f] = &brushes[i]->faces[f];
+    }
+
+    for (uint32_t i=0; i<header.brush_count; ++i) {
+        const snapshot_brush_t& record = snapshot.brushes[i];
+        brush_t *brush = brushes[i];
+        brush->box = record.box;
+        brush->intersecting_brushes.resize(record.intersecting_count);
+        for (uint32_t k=0; k<record.intersecting_count; ++k)
+            brush->intersecting_brushes[k] = brushes[snapshot.intersecting[record.first_intersecting + k]];
+
+        for (uint32_t f=0; f<record.plane_count; ++f) {
+            const snapshot_face_t& face_record = snapshot.faces[record.first_plane + f];
+            face_t& face = brush->faces[f];
+            load_vertices(snapshot, face_record.first_vertex, face_record.vertex_count, faces, face.vertices);
+            face.fragments.resize(face_record.fragment_count);
+            for (uint32_t k=0; k<face_record.fragment_count; ++k) {
+                const snapshot_fragment_t& fragment_record = snapshot.fragments[face_record.first_fragment + k];
+                fragment_t& fragment = face.fragments[k];
+                fragment.face = &face;
+                load_vertices(snapshot, fragment_record.first_vertex, fragment_record.vertex_count,
+                              faces, fragment.vertices);
+                fragment.front_volume = fragment_record.front_volume;
+                fragment.back_volume = fragment_record.back_volume;
+                fragment.front_brush = fragment_record.front_brush < 0? nullptr: brushes[fragment_record.front_brush];
+                fragment.back_brush = brushes[fragment_record.back_brush];
+                fragment.id = fragment_record.id;
+                fragment.relation = RELATION_OUTSIDE;
+            }
+        }
+        cache_face_planes(brush);
+
+        // nothing left for rebuild to do
+        brush->needs = 0;
+        brush->all_faces_dirty = false;
+        brush->dirty_boxes.clear();
+    }
+    world->dirty_brushes.clear();
+    return true;
+}
+
+}
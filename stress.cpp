@@ -0,0 +1,265 @@
+#include "csg.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <thread>
+
+using namespace csg;
+
+/*
+    stress test for concurrent queries. one thread per core runs a fixed mix
+    of point, box, ray and frustum queries against the same world, each with
+    its own result vectors, and compares every answer with the one computed
+    up front on a single thread. the second part queries world versions
+    while the world is edited and rebuilt on the main thread.
+
+    usage: stress [threads [rounds]], exits with 1 if any answer differed.
+    build it with -fsanitize=thread to have the races reported as well.
+*/
+
+using stress_clock = std::chrono::steady_clock;
+
+static double elapsed_ms(stress_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(stress_clock::now() - start).count();
+}
+
+static plane_t make_plane(const glm::dvec3& point, const glm::dvec3& normal) {
+    return plane_t{ vec3_t(normal), scalar_t(-glm::dot(point, normal)) };
+}
+
+static vector_t<plane_t> make_cube(const glm::dmat4& transform) {
+    glm::dmat4 normal_matrix = glm::transpose(glm::inverse(transform));
+    vector_t<plane_t> planes;
+    for (int axis=0; axis<3; ++axis) {
+        for (double sign : {1.0, -1.0}) {
+            glm::dvec3 normal(0.0);
+            normal[axis] = sign;
+            glm::dvec3 point = glm::dvec3(transform * glm::dvec4(normal, 1.0));
+            glm::dvec3 n = glm::normalize(glm::dvec3(normal_matrix * glm::dvec4(normal, 0.0)));
+            planes.push_back(make_plane(point, n));
+        }
+    }
+    return planes;
+}
+
+struct query_t {
+    query_type_t kind;
+    vec3_t       point;
+    vec3_t       direction;
+    mat4_t       view_projection;
+};
+
+// what each thread keeps between queries, so queries don't allocate once
+// the vectors are large enough
+struct scratch_t {
+    vector_t<brush_t*>               brushes;
+    vector_t<ray_hit_t>              hits;
+    vector_t<const brush_version_t*> version_brushes;
+    vector_t<version_ray_hit_t>      version_hits;
+};
+
+static uint64_t mix(uint64_t hash, uint64_t value) {
+    hash ^= value + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+static box_t query_box_of(const query_t& query) {
+    return box_t{ query.point - vec3_t(2), query.point + vec3_t(2) };
+}
+
+// hash of the answer, the same on every thread for the same world
+static uint64_t run_query(const world_t& world, const query_t& query, scratch_t& scratch) {
+    uint64_t hash = query.kind;
+    switch (query.kind) {
+    case QUERY_POINT:
+        world.query_point(query.point, scratch.brushes);
+        break;
+    case QUERY_BOX:
+        world.query_box(query_box_of(query), scratch.brushes);
+        break;
+    case QUERY_FRUSTUM:
+        world.query_frustum(query.view_projection, scratch.brushes);
+        break;
+    case QUERY_RAY:
+        world.query_ray(ray_t{ query.point, query.direction }, scratch.hits);
+        for (const ray_hit_t& hit: scratch.hits)
+            hash = mix(mix(hash, hit.brush->get_uid()), hit.fragment->id);
+        return hash;
+    }
+    for (const brush_t *brush: scratch.brushes)
+        hash = mix(hash, brush->get_uid());
+    return hash;
+}
+
+static uint64_t run_query(const world_version_t& version, const query_t& query, scratch_t& scratch) {
+    uint64_t hash = query.kind;
+    switch (query.kind) {
+    case QUERY_POINT:
+        version.query_point(query.point, scratch.version_brushes);
+        break;
+    case QUERY_BOX:
+        version.query_box(query_box_of(query), scratch.version_brushes);
+        break;
+    case QUERY_FRUSTUM:
+        version.query_frustum(query.view_projection, scratch.version_brushes);
+        break;
+    case QUERY_RAY:
+        version.query_ray(ray_t{ query.point, query.direction }, scratch.version_hits);
+        for (const version_ray_hit_t& hit: scratch.version_hits)
+            hash = mix(mix(hash, hit.brush->uid), hit.fragment->id);
+        return hash;
+    }
+    for (const brush_version_t *brush: scratch.version_brushes)
+        hash = mix(hash, brush->uid);
+    return hash;
+}
+
+static vector_t<query_t> make_queries(int count, double spread) {
+    std::mt19937 rng(4321);
+    std::uniform_real_distribution<double> position(-spread, spread);
+    std::uniform_real_distribution<double> direction(-1.0, 1.0);
+    vector_t<query_t> queries(count);
+    for (int i=0; i<count; ++i) {
+        query_t& query = queries[i];
+        query.kind = query_type_t(i % 4);
+        query.point = vec3_t(position(rng), position(rng), position(rng));
+        query.direction = vec3_t(glm::normalize(glm::dvec3(direction(rng), direction(rng), direction(rng)) +
+                                                glm::dvec3(1e-3)));
+        query.view_projection = mat4_t(glm::perspective(1.0, 1.0, 0.1, spread) *
+            glm::lookAt(glm::dvec3(query.point), glm::dvec3(0.0), glm::dvec3(0.0, 1.0, 0.0)));
+    }
+    return queries;
+}
+
+static void add_brushes(world_t& world, int count, double spread) {
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<double> position(-spread, spread);
+    std::uniform_real_distribution<double> angle(0.0, 3.14159);
+    std::uniform_real_distribution<double> scale(0.5, 3.0);
+    for (int i=0; i<count; ++i) {
+        glm::dmat4 transform = glm::translate(glm::dmat4(1.0), glm::dvec3(position(rng), position(rng), position(rng)));
+        transform = glm::rotate(transform, angle(rng), glm::normalize(glm::dvec3(1.0, 2.0, 3.0)));
+        transform = glm::scale(transform, glm::dvec3(scale(rng), scale(rng), scale(rng)));
+        brush_t *brush = world.add();
+        brush->set_planes(make_cube(transform));
+        brush->set_volume_operation(make_fill_operation(i % 3 == 0? 0: 1));
+    }
+}
+
+// every thread runs all queries rounds times, starting at a different one
+static bool stress_world(const world_t& world, const vector_t<query_t>& queries, int thread_count, int rounds) {
+    scratch_t scratch;
+    vector_t<uint64_t> expected(queries.size());
+    for (size_t i=0; i<queries.size(); ++i)
+        expected[i] = run_query(world, queries[i], scratch);
+
+    std::atomic<long> mismatches{0};
+    auto start = stress_clock::now();
+    vector_t<std::thread> threads;
+    for (int t=0; t<thread_count; ++t) {
+        threads.emplace_back([&, t]() {
+            scratch_t scratch;
+            size_t offset = queries.size() * t / thread_count;
+            for (int round=0; round<rounds; ++round) {
+                for (size_t i=0; i<queries.size(); ++i) {
+                    size_t q = (i + offset) % queries.size();
+                    if (run_query(world, queries[q], scratch) != expected[q])
+                        mismatches += 1;
+                }
+            }
+        });
+    }
+    for (std::thread& thread: threads)
+        thread.join();
+    double ms = elapsed_ms(start);
+    double total = double(queries.size()) * rounds * thread_count;
+    printf("  world    %d threads  %10.0f queries  %8.1f ms  %10.0f queries/s  %ld mismatches\n",
+           thread_count, total, ms, total / ms * 1e3, long(mismatches));
+    return mismatches == 0;
+}
+
+// readers query whatever version was published last while the main thread
+// moves brushes around, every answer is checked against one computed for
+// the same version
+static bool stress_versions(world_t& world, const vector_t<query_t>& queries, int thread_count, int rounds) {
+    struct published_t {
+        std::shared_ptr<const world_version_t> version;
+        vector_t<uint64_t>                     expected;
+    };
+    auto publish = [&]() {
+        auto published = std::make_shared<published_t>();
+        published->version = world.get_version();
+        scratch_t scratch;
+        for (const query_t& query: queries)
+            published->expected.push_back(run_query(*published->version, query, scratch));
+        return std::shared_ptr<const published_t>(published);
+    };
+
+    std::mutex mutex;
+    std::shared_ptr<const published_t> current = publish();
+    std::atomic<bool> stop{false};
+    std::atomic<long> mismatches{0}, count{0};
+    vector_t<std::thread> threads;
+    for (int t=0; t<thread_count; ++t) {
+        threads.emplace_back([&, t]() {
+            scratch_t scratch;
+            size_t q = queries.size() * t / thread_count;
+            while (!stop) {
+                std::shared_ptr<const published_t> published;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    published = current;
+                }
+                for (int i=0; i<64; ++i, q = (q + 1) % queries.size()) {
+                    if (run_query(*published->version, queries[q], scratch) != published->expected[q])
+                        mismatches += 1;
+                }
+                count += 64;
+                std::this_thread::yield();
+            }
+        });
+    }
+
+    auto start = stress_clock::now();
+    for (int round=0; round<rounds; ++round) {
+        int i = 0;
+        for (brush_t *brush = world.first(); brush; brush = world.next(brush), ++i) {
+            if (i % 16 == round % 16)
+                brush->translate(vec3_t(round % 2? 0.5: -0.5, 0, 0));
+        }
+        world.rebuild();
+        std::shared_ptr<const published_t> published = publish();
+        std::lock_guard<std::mutex> lock(mutex);
+        current = published;
+    }
+    stop = true;
+    for (std::thread& thread: threads)
+        thread.join();
+    double ms = elapsed_ms(start);
+    printf("  versions %d threads  %10ld queries  %8.1f ms  %d rebuilds  %ld mismatches\n",
+           thread_count, long(count), ms, rounds, long(mismatches));
+    return mismatches == 0;
+}
+
+int main(int argc, char **argv) {
+    int thread_count = argc > 1? atoi(argv[1]): int(std::thread::hardware_concurrency());
+    int rounds = argc > 2? atoi(argv[2]): 20;
+    thread_count = glm::max(thread_count, 1);
+
+    world_t world;
+    add_brushes(world, 1000, 40.0);
+    world.rebuild();
+    vector_t<query_t> queries = make_queries(4096, 45.0);
+
+    bool ok = stress_world(world, queries, thread_count, rounds);
+    ok = stress_versions(world, queries, thread_count, rounds) && ok;
+    printf("%s\n", ok? "ok": "FAILED");
+    return ok? 0: 1;
+}
@@ -0,0 +1,56 @@
+#include "csg_private.hpp"
+
+namespace csg {
+
+static void copy_positions(const vector_t<vertex_t>& from, vector_t<vertex_t>& to) {
+    to.resize(from.size());
+    for (size_t i=0; i<from.size(); ++i)
+        to[i].position = from[i].position;
+}
+
+static std::shared_ptr<const brush_version_t> make_brush_version(const brush_t *brush) {
+    brush_version_t *version = new brush_version_t;
+    version->planes = brush->planes;
+    version->box = brush->box;
+    version->time = brush->time;
+    version->uid = brush->uid;
+    version->faces.resize(brush->faces.size());
+    for (size_t i=0; i<brush->faces.size(); ++i) {
+        const face_t& from = brush->faces[i];
+        face_t& face = version->faces[i];
+        face.plane = &version->planes[i];
+        face.plane_id = from.plane_id;
+        face.plane_sign = from.plane_sign;
+        copy_positions(from.vertices, face.vertices);
+        face.fragments.resize(from.fragments.size());
+        for (size_t k=0; k<from.fragments.size(); ++k) {
+            const fragment_t& from_fragment = from.fragments[k];
+            fragment_t& fragment = face.fragments[k];
+            fragment.face = &face;
+            copy_positions(from_fragment.vertices, fragment.vertices);
+            fragment.front_volume = from_fragment.front_volume;
+            fragment.back_volume = from_fragment.back_volume;
+            fragment.front_brush = nullptr;
+            fragment.back_brush = nullptr;
+            fragment.id = from_fragment.id;
+            fragment.relation = from_fragment.relation;
+        }
+    }
+    return std::shared_ptr<const brush_version_t>(version);
+}
+
+std::shared_ptr<const world_version_t> world_t::get_version() {
+    // the faces of edited brushes are only right again after a rebuild
+    if (!dirty_brushes.empty() || !edited_brushes.empty() || !removed_brushes.empty())
+        return nullptr;
+    world_version_t *version = new world_version_t;
+    version->void_volume = void_volume;
+    for (brush_t *brush = first(); brush; brush = next(brush)) {
+        if (!brush->version)
+            brush->version = make_brush_version(brush);
+        version->brushes.push_back(brush->version);
+    }
+    return std::shared_ptr<const world_version_t>(version);
+}
+
+}